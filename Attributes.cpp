@@ -0,0 +1,255 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Attributes.h"
+
+#include <tree.h>
+#include <stringpool.h>
+#include <attribs.h>
+#include <diagnostic-core.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static const Policy* gPolicy = nullptr;
+
+/**
+ * Call fn for every comma separated token in the string arguments of a
+ * hellscape attribute, e.g.: hellscape("fla, bcf", "subLoop=2").
+ */
+template <typename Fn>
+static void for_each_token(tree args, Fn fn) {
+  for (tree arg = args; arg != NULL_TREE; arg = TREE_CHAIN(arg)) {
+    tree value = TREE_VALUE(arg);
+    if (TREE_CODE(value) != STRING_CST) continue;
+
+    std::string list = TREE_STRING_POINTER(value);
+    size_t pos = 0;
+    while (pos <= list.size()) {
+      size_t end = list.find(',', pos);
+      if (end == std::string::npos) end = list.size();
+
+      std::string token = list.substr(pos, end - pos);
+      token.erase(0, token.find_first_not_of(' '));
+      token.erase(token.find_last_not_of(' ') + 1);
+      if (!token.empty()) fn(token);
+
+      pos = end + 1;
+    }
+  }
+}
+
+/**
+ * Parse the value of a subLoop=N token.
+ *
+ * @return true if the token is a well-formed subLoop override
+ */
+static bool parse_sub_loop(const std::string& token, uint32_t* subLoop) {
+  static const char prefix[] = "subLoop=";
+  if (token.compare(0, sizeof(prefix) - 1, prefix) != 0) return false;
+
+  const char* value = token.c_str() + sizeof(prefix) - 1;
+  char* none;
+  unsigned long n = strtoul(value, &none, 10);
+  if (*value == 0 || *none != 0) return false;
+
+  *subLoop = n;
+  return true;
+}
+
+static tree handle_hellscape_attribute(tree* node, tree name, tree args,
+                                       int flags, bool* no_add_attrs) {
+  if (TREE_CODE(*node) != FUNCTION_DECL) {
+    warning(OPT_Wattributes, "%qE attribute only applies to functions", name);
+    *no_add_attrs = true;
+    return NULL_TREE;
+  }
+
+  for (tree arg = args; arg != NULL_TREE; arg = TREE_CHAIN(arg)) {
+    if (TREE_CODE(TREE_VALUE(arg)) != STRING_CST) {
+      error("%qE attribute arguments must be strings", name);
+      *no_add_attrs = true;
+      return NULL_TREE;
+    }
+  }
+
+  for_each_token(args, [&](const std::string& token) {
+    uint32_t subLoop;
+    if (token != "fla" && token != "bcf" && token != "sub" && token != "str" &&
+        token != "con" && !parse_sub_loop(token, &subLoop)) {
+      error("unknown %qE attribute argument %qs", name, token.c_str());
+      *no_add_attrs = true;
+    }
+  });
+
+  return NULL_TREE;
+}
+
+static tree handle_hellscape_off_attribute(tree* node, tree name, tree args,
+                                           int flags, bool* no_add_attrs) {
+  if (TREE_CODE(*node) != FUNCTION_DECL) {
+    warning(OPT_Wattributes, "%qE attribute only applies to functions", name);
+    *no_add_attrs = true;
+  }
+
+  return NULL_TREE;
+}
+
+// name, min_len, max_len, decl_req, type_req, fn_type_req, affects_type_identity, handler, exclude
+static struct attribute_spec hellscape_attr = {
+  "hellscape", 0, -1, true, false, false, false, handle_hellscape_attribute, NULL
+};
+
+static struct attribute_spec hellscape_off_attr = {
+  "hellscape_off", 0, 0, true, false, false, false, handle_hellscape_off_attribute, NULL
+};
+
+void register_attributes(void* gcc_data, void* user_data) {
+  register_attribute(&hellscape_attr);
+  register_attribute(&hellscape_off_attr);
+}
+
+void set_policy(const Policy* policy) {
+  gPolicy = policy;
+}
+
+/**
+ * Look the function up in the policy, by its source name first (as printed in
+ * diagnostics) and then by its symbol name.
+ *
+ * @return the matching rule, or nullptr
+ */
+static const Policy::Rule* policy_rule(function* f) {
+  if (!gPolicy) return nullptr;
+
+  const Policy::Rule* rule = gPolicy->lookup(function_name(f));
+  if (!rule && DECL_ASSEMBLER_NAME_SET_P(f->decl)) {
+    rule = gPolicy->lookup(hellscape_symbol(f).c_str());
+  }
+
+  return rule;
+}
+
+/**
+ * The attributes and the policy decide, see hellscape_enabled.
+ */
+static bool decide_enabled(function* f, tree attrs, const char* pass, bool enable) {
+  if (lookup_attribute("hellscape_off", attrs)) return false;
+
+  const Policy::Rule* rule = policy_rule(f);
+  if (rule && (rule->flags & Policy::HAS_PASSES)) {
+    enable = (rule->passes & Policy::pass_bit(pass)) != 0;
+  }
+
+  tree attr = lookup_attribute("hellscape", attrs);
+  if (!attr) return enable;
+
+  // hellscape without arguments opts into everything.
+  tree args = TREE_VALUE(attr);
+  if (args == NULL_TREE) return true;
+
+  // Only parameters, e.g.: hellscape("subLoop=2"), keep the command line passes.
+  bool passes = false;
+  bool listed = false;
+  for_each_token(args, [&](const std::string& token) {
+    if (token == "fla" || token == "bcf" || token == "sub" || token == "str" || token == "con") {
+      passes = true;
+    }
+    if (token == pass) listed = true;
+  });
+
+  return passes ? listed : enable;
+}
+
+/**
+ * @return true if the hellscape_done marker in attrs lists pass
+ */
+static bool done_before(tree attrs, const char* pass) {
+  tree done = lookup_attribute("hellscape_done", attrs);
+  if (!done) return false;
+
+  bool listed = false;
+  for_each_token(TREE_VALUE(done), [&](const std::string& token) {
+    if (token == pass) listed = true;
+  });
+
+  return listed;
+}
+
+bool hellscape_enabled(function* f, const char* pass, bool enable) {
+  tree attrs = DECL_ATTRIBUTES(f->decl);
+
+  // Obfuscated by this pass before it was streamed out at compile time, LTRANS
+  // must not do it again. The passes which only run after IPA (e.g.: BCF and
+  // FLA in hot mode) still have to.
+  if (in_lto_p && done_before(attrs, pass)) return false;
+
+  return decide_enabled(f, attrs, pass, enable);
+}
+
+void hellscape_done(function* f, const char* pass) {
+  // Only LTRANS reads it back, from the bytecode. Passes which run after IPA
+  // only get here once the bytecode is written, so it only ever lists what
+  // ran before.
+  tree attrs = DECL_ATTRIBUTES(f->decl);
+  if (!flag_generate_lto || done_before(attrs, pass)) return;
+
+  // Internal marker, hellscape_done("sub", "con"), streamed into the LTO
+  // bytecode with the declaration.
+  size_t length = strlen(pass) + 1;
+  tree name = build_string(length, pass);
+  TREE_TYPE(name) = build_array_type_nelts(char_type_node, length);
+
+  // A new head, the list may be shared with clones of the declaration.
+  tree done = lookup_attribute("hellscape_done", attrs);
+  tree passes = chainon(done ? copy_list(TREE_VALUE(done)) : NULL_TREE,
+                        build_tree_list(NULL_TREE, name));
+  DECL_ATTRIBUTES(f->decl) = tree_cons(get_identifier("hellscape_done"), passes, attrs);
+}
+
+uint32_t hellscape_sub_loop(function* f, uint32_t subLoop) {
+  const Policy::Rule* rule = policy_rule(f);
+  if (rule && (rule->flags & Policy::HAS_SUB_LOOP)) {
+    subLoop = rule->subLoop;
+  }
+
+  tree attr = lookup_attribute("hellscape", DECL_ATTRIBUTES(f->decl));
+  if (!attr) return subLoop;
+
+  for_each_token(TREE_VALUE(attr), [&](const std::string& token) {
+    parse_sub_loop(token, &subLoop);
+  });
+
+  return subLoop;
+}
+
+std::string hellscape_symbol(function* f) {
+  std::string symbol = IDENTIFIER_POINTER(DECL_ASSEMBLER_NAME(f->decl));
+
+  // N depends on the other static functions of that name in the program, it
+  // must not change the obfuscation of this one.
+  static const char suffix[] = ".lto_priv.";
+  size_t pos;
+  while ((pos = symbol.find(suffix)) != std::string::npos) {
+    size_t end = pos + sizeof(suffix) - 1;
+    while (end < symbol.size() && ISDIGIT(symbol[end])) end++;
+    symbol.erase(pos, end - pos);
+  }
+
+  return symbol;
+}
@@ -0,0 +1,76 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gcc-plugin.h>
+#include <function.h>
+
+#include <cstdint>
+#include <string>
+
+#include "Policy.h"
+
+/**
+ * Register __attribute__((hellscape("fla,bcf,sub,str,con,subLoop=N"))) and
+ * __attribute__((hellscape_off)), called on PLUGIN_ATTRIBUTES.
+ */
+void register_attributes(void* gcc_data, void* user_data);
+
+/**
+ * Use a compiled policy for functions without attributes.
+ *
+ * @param policy policy mapped from -fplugin-arg-hellscape-policy, owned by the caller
+ */
+void set_policy(const Policy* policy);
+
+/**
+ * Decide whether a pass transforms a function. hellscape_off disables every
+ * pass, a bare hellscape enables every pass and hellscape("fla,...") exactly
+ * the listed ones. Otherwise (including hellscape("subLoop=N")) the first
+ * matching policy rule decides, then the command line. In LTRANS, a pass
+ * skips the functions it already transformed at compile time.
+ *
+ * @param f function about to be transformed
+ * @param pass name of the pass, e.g.: "fla"
+ * @param enable whether the pass is enabled on the command line
+ * @return true if the pass should run on f
+ */
+bool hellscape_enabled(function* f, const char* pass, bool enable);
+
+/**
+ * Record that a pass transformed a function, when the function is about to be
+ * streamed into LTO bytecode, so LTRANS does not transform it again.
+ *
+ * @param f function the pass changed
+ * @param pass name of the pass, e.g.: "fla"
+ */
+void hellscape_done(function* f, const char* pass);
+
+/**
+ * @param f function about to be transformed
+ * @param subLoop subLoop given on the command line
+ * @return the subLoop override from hellscape("subLoop=N") or the policy, or subLoop
+ */
+uint32_t hellscape_sub_loop(function* f, uint32_t subLoop);
+
+/**
+ * @param f function about to be transformed
+ * @return the assembler name of f without the .lto_priv.N suffix WPA gives
+ *         static functions, which keys its random streams and policy rules
+ */
+std::string hellscape_symbol(function* f);
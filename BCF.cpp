@@ -16,6 +16,9 @@
  */
 
 #include "BCF.h"
+#include "Attributes.h"
+#include "Opaque.h"
+#include "Loops.h"
 
 #include <basic-block.h>
 #include <function.h>
@@ -25,9 +28,13 @@
 
 #include <gimple.h>
 #include <gimple-iterator.h>
+#include <ssa.h>
+#include <tree-into-ssa.h>
 
 #include <cgraph.h>
 #include <cfgloop.h>
+#include <cfgloopmanip.h>
+#include <dominance.h>
 
 #include <iostream>
 #include <vector>
@@ -37,40 +44,49 @@ void BCFPass::create_globals() {
   if (mX != NULL_TREE && mY != NULL_TREE) return;
 
   // Create global declarations for x and y, used for BCF.
-  mX = build_decl(UNKNOWN_LOCATION, VAR_DECL, get_identifier_with_length("$x", 2), integer_type_node);
-  // It's static we want to allocate storage for it.
-  TREE_STATIC(mX) = 1;
-  DECL_INITIAL(mX) = build_zero_cst(integer_type_node);
-  TREE_USED(mX) = 1;
-  TREE_PUBLIC(mX) = 1;
-  symtab_node* x_node = symtab_node::get_create(mX);
-  x_node->force_output = 1;
-  x_node->definition = 1;
-
-  mY = build_decl(UNKNOWN_LOCATION, VAR_DECL, get_identifier_with_length("$y", 2), integer_type_node);
-  // It's static we want to allocate storage for it.
-  TREE_STATIC(mY) = 1;
-  DECL_INITIAL(mY) = build_zero_cst(integer_type_node);
-  TREE_USED(mY) = 1;
-  TREE_PUBLIC(mY) = 1;
-  symtab_node* y_node = symtab_node::get_create(mY);
-  y_node->force_output = 1;
-  y_node->definition = 1;
+  mX = opaque_global("$x");
+  mY = opaque_global("$y");
 }
 
 unsigned int BCFPass::execute(function* f) {
-  if (!mEnable) return 0;
+  if (!hellscape_enabled(f, "bcf", mEnable)) return 0;
+
+  auto_client_timevar timevar("hellscape: bcf");
+  mBudget.begin(f);
+  Stats::Record record(mStats, f, "bcf");
+  Random::Stream random = mRandom.stream(hellscape_symbol(f).c_str(), "bcf");
 
   create_globals();
 
+  std::vector<int> collected_blocks;
+  // For all basic blocks SKIPPING the special entry and the special exit and any exit block returns.
+  for (basic_block bb = ENTRY_BLOCK_PTR_FOR_FN(f)->next_bb;
+       bb && bb->next_bb && bb->next_bb->next_bb; bb = bb->next_bb) {
+    collected_blocks.push_back(bb->index);
+  }
+
+  // Read x and y once on entry and keep them in registers (or spilled to the
+  // stack) rather than loading them in every guard.
+  tree x = mX;
+  tree y = mY;
+  if (mCache && !collected_blocks.empty()) {
+    basic_block load_block = split_edge(single_succ_edge(ENTRY_BLOCK_PTR_FOR_FN(f)));
+    gimple_stmt_iterator load_gsi = gsi_last_bb(load_block);
+
+    x = create_tmp_reg(integer_type_node, "x");
+    gsi_insert_after(&load_gsi, gimple_build_assign(x, mX), GSI_NEW_STMT);
+    y = create_tmp_reg(integer_type_node, "y");
+    gsi_insert_after(&load_gsi, gimple_build_assign(y, mY), GSI_NEW_STMT);
+  }
+
   // y < 10
-  tree first_cond = build2(LT_EXPR, boolean_type_node, mY,
+  tree first_cond = build2(LT_EXPR, boolean_type_node, y,
                            build_int_cst(integer_type_node, 10));
   // x + 1
-  tree second_cond = build2(PLUS_EXPR, integer_type_node, mX,
+  tree second_cond = build2(PLUS_EXPR, integer_type_node, x,
                             build_one_cst(integer_type_node));
   // x * (x + 1)
-  tree second_cond2 = build2(MULT_EXPR, integer_type_node, mX,
+  tree second_cond2 = build2(MULT_EXPR, integer_type_node, x,
                              second_cond);
   // x * (x + 1) & 1
   tree second_cond3 = build2(BIT_AND_EXPR, integer_type_node, second_cond2,
@@ -79,20 +95,50 @@ unsigned int BCFPass::execute(function* f) {
   tree second_cond4 = build2(EQ_EXPR, boolean_type_node, second_cond3,
                              build_zero_cst(integer_type_node));
 
-  std::vector<int> collected_blocks;
-  // For all basic blocks SKIPPING the special entry and the special exit and any exit block returns.
-  for (basic_block bb = ENTRY_BLOCK_PTR_FOR_FN(f)->next_bb;
-       bb && bb->next_bb && bb->next_bb->next_bb; bb = bb->next_bb) {
-    collected_blocks.push_back(bb->index);
-  }
+  // Keep the dominators (if there are any) and the loop tree up to date as the
+  // guards go in, so the passes after this one do not have to recompute them.
+  bool loops = current_loops && !loops_state_satisfies_p(f, LOOPS_NEED_FIXUP);
+  // add_loop finds the body of the new loop through the dominators, which is
+  // still cheaper than rediscovering every loop in a fixup.
+  if (loops) calculate_dominance_info(CDI_DOMINATORS);
+  bool dominators = dom_info_available_p(f, CDI_DOMINATORS);
+
+  const Budget::Costs& costs = mBudget.costs(f, TYPE_MODE(integer_type_node));
+  const Budget::Cost& guard = mCache ? costs.cached_guard : costs.guard;
+
+  // Profiler mode counts every evaluation of a predicate and what the budget
+  // charged for it.
+  tree counters = NULL_TREE;
+  bool changed = false;
 
   for (int i : collected_blocks) {
     basic_block target_block = BASIC_BLOCK_FOR_FN(f, i);
 
+    // Leave hot blocks alone, a guard there is paid on every iteration. So
+    // are blocks the budget cannot afford a guard in any more.
+    bool hot = mProfile.is_hot(target_block);
+    bool picked = !hot && mBudget.pick("bcf", random);
+    bool guarded = picked && mBudget.charge(f, target_block, guard);
+    if (picked && !guarded) record.count("over_budget");
+    mProfile.account("bcf", target_block, guarded);
+    if (!guarded) continue;
+
+    record.count("predicates");
+    changed = true;
+
     // Create the guard block by splitting the edge between the entry and the real
     // basic block, then insert the condition into the guard block.
     edge cond_to_target = split_block_after_labels(target_block);
     basic_block conditional_block = cond_to_target->src;
+
+    // In SSA form the PHI nodes stay behind in the original block, give the
+    // guard a block of its own so the junk block does not have to feed them.
+    // A loop header gets one as well, so the guard's loop nests inside the
+    // header's loop rather than adding a second latch to it.
+    if (!gimple_seq_empty_p(phi_nodes(conditional_block)) ||
+        (loops && conditional_block->loop_father->header == conditional_block)) {
+      conditional_block = split_edge(cond_to_target);
+    }
     gimple_stmt_iterator gsi = gsi_last_bb(conditional_block);
 
     // Create a NOP so the builder has an insertion point.
@@ -105,6 +151,11 @@ unsigned int BCFPass::execute(function* f) {
     gsi_insert_after(&gsi, gimple_build_cond(NE_EXPR, opaque_cond,
                                              boolean_false_node, NULL_TREE,
                                              NULL_TREE), GSI_NEW_STMT);
+    if (mInstrument.enabled()) {
+      if (!counters) counters = mInstrument.counters(f);
+      mInstrument.count(f, &gsi, counters, Instrument::PREDICATES);
+      mInstrument.count_cost(f, &gsi, counters, guard.time);
+    }
 
     // Create a junk block by splitting the edge between the conditional block
     // and the real block.
@@ -113,31 +164,55 @@ unsigned int BCFPass::execute(function* f) {
     gsi_insert_after(&junk_gsi, gimple_build_nop(), GSI_NEW_STMT);
 
     // Mark the default fallthrough of the conditional block pointing to the junk
-    // block the false value.
+    // block the false value, which is never taken.
     edge enter_e = EDGE_SUCC(conditional_block, 0);
     enter_e->flags &= ~EDGE_FALLTHRU;
     enter_e->flags |= EDGE_FALSE_VALUE;
+    enter_e->probability = profile_probability::never();
 
     // Add a true value to the conditional block that jumps to the real basic
-    // block.
-    edge new_e2 = make_edge(conditional_block, single_succ(junk_block),
-                            EDGE_TRUE_VALUE);
-    (void) new_e2;
+    // block, always taken so the real path stays the fall-through.
+    basic_block real_block = single_succ(junk_block);
+    edge new_e2 = make_edge(conditional_block, real_block, EDGE_TRUE_VALUE);
+    new_e2->probability = profile_probability::always();
+    Profile::mark_cold(f, junk_block);
 
     // Now make the junk block loop back to the conditional block.
     remove_bb_from_loops(junk_block);
     add_bb_to_loop(junk_block, conditional_block->loop_father);
     redirect_edge_succ(single_succ_edge(junk_block), conditional_block);
+
+    // Splitting the edge made the junk block the real block's dominator, but
+    // the guard is its only predecessor now.
+    if (dominators) set_immediate_dominator(CDI_DOMINATORS, real_block, conditional_block);
+
+    // The guard heads a new loop, closed by the junk block.
+    if (loops) {
+      loop_p loop = alloc_loop();
+      loop->header = conditional_block;
+      loop->latch = junk_block;
+      add_loop(loop, conditional_block->loop_father);
+    }
   }
 
-  // Fix-up since we've added loops.
-  loops_state_set(LOOPS_NEED_FIXUP);
+  if (loops) {
+    restore_loop_properties(f);
+  } else if (current_loops) {
+    loops_state_set(LOOPS_NEED_FIXUP);
+  }
+
+  if (changed) hellscape_done(f, "bcf");
 
-  // We've moved the CFG around a lot, so throw away the computed dominators.
-  free_dominance_info(f, CDI_DOMINATORS);
+  // Splitting blocks and edges keeps the dominators up to date, but not the
+  // post-dominators.
   free_dominance_info(f, CDI_POST_DOMINATORS);
 
-//    GraphVizGFG(g).execute(f);
+  // The guards load x and y, after into-SSA those loads need virtual operands.
+  // The cached copies are new variables and need renaming as well.
+  if (gimple_in_ssa_p(f)) {
+    mark_virtual_operands_for_renaming(f);
+    return mCache ? TODO_update_ssa : TODO_update_ssa_only_virtuals;
+  }
 
   return 0;
 }
\ No newline at end of file
@@ -26,25 +26,37 @@
 #include <memory>
 
 #include "Random.h"
+#include "Stats.h"
+#include "Profile.h"
+#include "Budget.h"
+#include "Instrument.h"
 
 const pass_data bcf_pass_data = {
   GIMPLE_PASS,
   "bcf",
 
   OPTGROUP_NONE,
-  TV_NONE,
+  TV_PLUGIN_RUN,
   PROP_gimple_any,
   0, 0, 0, 0
 };
 
 struct BCFPass : gimple_opt_pass {
   Random& mRandom;
+  Profile& mProfile;
+  Stats& mStats;
+  Budget& mBudget;
+  Instrument& mInstrument;
   tree mX = NULL_TREE;
   tree mY = NULL_TREE;
+  // Load x and y once per function instead of once per guard.
+  bool mCache;
   bool mEnable;
 
-  BCFPass(gcc::context* context, Random& random, bool enable = true) : gimple_opt_pass(
-    bcf_pass_data, context), mRandom(random), mEnable(enable) {
+  BCFPass(gcc::context* context, Random& random, Profile& profile, Stats& stats, Budget& budget,
+          Instrument& instrument, bool cache = false, bool enable = true)
+    : gimple_opt_pass(bcf_pass_data, context), mRandom(random), mProfile(profile),
+      mStats(stats), mBudget(budget), mInstrument(instrument), mCache(cache), mEnable(enable) {
   }
 
   void create_globals();
@@ -0,0 +1,236 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Budget.h"
+#include "Loops.h"
+
+#include <tree.h>
+#include <gimple.h>
+#include <tree-inline.h>
+#include <profile-count.h>
+#include <sreal.h>
+#include <rtl.h>
+#include <predict.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+// Loops nested deeper are not assumed to run any more often.
+static const int MAX_DEPTH = 6;
+
+/**
+ * @return a register of mode, for pricing code that is never emitted
+ */
+static rtx price_reg(machine_mode mode, unsigned n) {
+  return gen_raw_REG(mode, LAST_VIRTUAL_REGISTER + 1 + n);
+}
+
+/**
+ * @return the cost of a load or a store of mode, through a register
+ */
+static int memory_cost(machine_mode mode, bool speed) {
+  return COSTS_N_INSNS(1) + address_cost(price_reg(Pmode, 0), mode, ADDR_SPACE_GENERIC, speed);
+}
+
+/**
+ * @return the cost of an operation on registers of mode
+ */
+static int operation_cost(rtx_code code, machine_mode mode, bool speed) {
+  rtx x = GET_RTX_LENGTH(code) == 1
+          ? gen_rtx_fmt_e(code, mode, price_reg(mode, 1))
+          : gen_rtx_fmt_ee(code, mode, price_reg(mode, 1), price_reg(mode, 2));
+  return std::max(set_src_cost(x, mode, speed), COSTS_N_INSNS(1));
+}
+
+/**
+ * Price every piece of code the passes add for the current target, in
+ * instructions.
+ *
+ * @param mode mode the code computes in
+ * @param speed whether to price time rather than size
+ * @param field where the prices go, Cost::time or Cost::size
+ */
+static void price(Budget::Costs* costs, machine_mode mode, bool speed,
+                  double Budget::Cost::* field) {
+  int load = memory_cost(mode, speed);
+  int store = memory_cost(mode, speed);
+  // The passes' branches always go the same way.
+  int branch = COSTS_N_INSNS(std::max(BRANCH_COST(speed, true), 1));
+  int jump = COSTS_N_INSNS(1);
+  auto op = [&](rtx_code code) {
+    return operation_cost(code, mode, speed);
+  };
+  auto insns = [](int cost) {
+    return (double) cost / COSTS_N_INSNS(1);
+  };
+
+  // y < 10 || (x * (x + 1) & 1) == 0, the junk block only adds to the size.
+  int predicate = op(LT) + op(PLUS) + op(MULT) + op(AND) + op(EQ) + op(IOR) + branch;
+  int junk = speed ? 0 : jump;
+  costs->guard.*field = insns(2 * load + predicate + junk);
+  costs->cached_guard.*field = insns(predicate + junk);
+
+  costs->transition.*field = insns(store + jump);
+  costs->compare.*field = insns(op(LTU) + branch);
+  costs->lookup.*field = insns(op(MINUS) + op(MULT) + memory_cost(Pmode, speed) + jump);
+
+  // The decrypt and wait loops only run once, they only add to the size.
+  int check = load + op(EQ) + branch;
+  if (!speed) {
+    int claim = load + store + op(EQ) + branch;
+    int decrypt = jump + memory_cost(QImode, speed) + op(MULT) + op(PLUS) + op(LSHIFTRT) +
+                  op(XOR) + memory_cost(QImode, speed) + op(PLUS) + op(LTU) + branch;
+    int publish = store + jump;
+    int wait = load + op(NE) + branch;
+    check += claim + decrypt + publish + wait;
+  }
+  costs->check.*field = insns(check);
+
+  // (a ^ b) + 2 * (a & b), with a = k1 + z and b = (c - k1) + z.
+  costs->decode.*field = insns(load + 3 * op(PLUS) + op(XOR) + op(AND) + op(ASHIFT));
+}
+
+const Budget::Costs& Budget::costs(function* f, machine_mode mode) {
+  // Only integer modes have meaningful costs.
+  if (!SCALAR_INT_MODE_P(mode)) mode = word_mode;
+
+  auto key = std::make_pair(DECL_FUNCTION_SPECIFIC_TARGET(f->decl), mode);
+  auto it = mCosts.find(key);
+  if (it != mCosts.end()) return it->second;
+
+  Costs& costs = mCosts[key];
+  price(&costs, mode, true, &Cost::time);
+  price(&costs, mode, false, &Cost::size);
+  return costs;
+}
+
+bool Budget::pick(const char* pass, Random::Stream& random) const {
+  uint32_t percent = 100;
+  if (strcmp(pass, "fla") == 0) percent = mPerFLA;
+  if (strcmp(pass, "bcf") == 0) percent = mPerBCF;
+  if (strcmp(pass, "sub") == 0) percent = mPerSUB;
+
+  if (percent >= 100) return true;
+  return (uint32_t) random.nextInt() % 100 < percent;
+}
+
+/**
+ * @param f function with an up to date loop tree
+ * @param bb block of f
+ * @return the estimated executions of bb per call of f
+ */
+static double frequency(function* f, basic_block bb) {
+  profile_count entry = ENTRY_BLOCK_PTR_FOR_FN(f)->count;
+  if (bb->count.initialized_p() && entry.initialized_p() && entry.nonzero_p()) {
+    return bb->count.to_sreal_scale(entry).to_double();
+  }
+
+  if (!bb->loop_father) return 1;
+  return pow(10, std::min(bb_loop_depth(bb), MAX_DEPTH));
+}
+
+/**
+ * @return GCC's size estimate of the function
+ */
+static double function_size(function* f) {
+  double size = 0;
+
+  basic_block bb;
+  FOR_EACH_BB_FN(bb, f) {
+    size += estimate_num_insns_seq(bb_seq(bb), &eni_size_weights);
+  }
+
+  return size;
+}
+
+void Budget::begin(function* f) {
+  if (!enabled()) return;
+
+  bool first = mAccounts.count(DECL_UID(f->decl)) == 0;
+  Account& account = mAccounts[DECL_UID(f->decl)];
+
+  if (first && time_enabled()) {
+    update_loops(f);
+
+    basic_block bb;
+    FOR_EACH_BB_FN(bb, f) {
+      account.cost += frequency(f, bb) * estimate_num_insns_seq(bb_seq(bb), &eni_time_weights);
+    }
+  }
+
+  if (size_enabled()) {
+    double size = function_size(f);
+    if (first) {
+      account.base = size;
+      mTUBase += size;
+    }
+
+    mTUSize += size - account.size;
+    account.size = size;
+  }
+}
+
+bool Budget::fits(const Account& account, double size) const {
+  if (mMaxGrowth > 0 && account.size + size > account.base * mMaxGrowth) return false;
+  if (mMaxTUGrowth > 0 && mTUSize + size > mTUBase * mMaxTUGrowth) return false;
+
+  return true;
+}
+
+bool Budget::fits(function* f, double size) const {
+  if (!size_enabled()) return true;
+
+  auto it = mAccounts.find(DECL_UID(f->decl));
+  return it == mAccounts.end() || fits(it->second, size);
+}
+
+bool Budget::charge(function* f, basic_block bb, double cost, double size) {
+  if (!enabled()) return true;
+
+  Account& account = mAccounts[DECL_UID(f->decl)];
+  double overhead = time_enabled() ? frequency(f, bb) * cost : 0;
+  if (time_enabled() && account.spent + overhead > account.cost * mMaxOverhead) return false;
+
+  if (size_enabled() && !fits(account, size)) {
+    if (!account.exhausted) {
+      account.exhausted = true;
+
+      std::ostringstream out;
+      out << function_name(f) << " (" << account.base << " -> " << account.size << ")";
+      mExhausted.push_back(out.str());
+    }
+
+    return false;
+  }
+
+  account.spent += overhead;
+  account.size += size;
+  mTUSize += size;
+  return true;
+}
+
+void Budget::report(std::ostream& out) const {
+  if (mExhausted.empty()) return;
+
+  out << "note: hellscape: " << mExhausted.size()
+      << " functions used up their size budget (estimated size before -> at the limit):\n";
+  for (const std::string& name : mExhausted) {
+    out << "note: hellscape:   " << name << "\n";
+  }
+}
@@ -0,0 +1,186 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gcc-plugin.h>
+#include <function.h>
+#include <basic-block.h>
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Random.h"
+
+/**
+ * Static cost model capping the runtime overhead and the code growth the
+ * passes add, for -fplugin-arg-hellscape-maxOverhead=N%, maxGrowth=F,
+ * maxTUGrowth=F and perFLA/perBCF/perSUB.
+ *
+ * A block is weighted by its execution frequency relative to the function
+ * entry, from the (read or guessed) profile counts when there are any and
+ * 10^loop depth otherwise. A function costs its frequency weighted time
+ * estimate when the first pass looks at it, every guard, transition or
+ * rewrite then charges its own cost (priced for the target, see costs())
+ * times the frequency of its block until the function's share is spent.
+ *
+ * Sizes are GCC's size estimates, taken again before every pass so the
+ * charges of one pass never drift far from the real size. Every
+ * transformation charges its size until the function (or the translation
+ * unit so far) reaches its growth factor.
+ */
+class Budget {
+private:
+  struct Account {
+    double cost = 0;
+    double spent = 0;
+    // Size before the first pass and now.
+    double base = 0;
+    double size = 0;
+    bool exhausted = false;
+  };
+
+  // Fraction of the function's cost the passes may add, 0 for no limit.
+  double mMaxOverhead;
+  // Factor functions and the translation unit may grow by, 0 for no limit.
+  double mMaxGrowth;
+  double mMaxTUGrowth;
+  // Percentage of candidates each pass transforms.
+  uint32_t mPerFLA;
+  uint32_t mPerBCF;
+  uint32_t mPerSUB;
+  // By DECL_UID, the cost is taken before the first pass changes the function.
+  std::map<unsigned, Account> mAccounts;
+  // Sizes of the functions seen so far.
+  double mTUBase = 0;
+  double mTUSize = 0;
+  // Functions which used up their size budget, for the report.
+  std::vector<std::string> mExhausted;
+  // By target options and mode.
+  std::map<std::pair<tree, machine_mode>, Costs> mCosts;
+
+  bool time_enabled() const {
+    return mMaxOverhead > 0;
+  }
+
+  bool size_enabled() const {
+    return mMaxGrowth > 0 || mMaxTUGrowth > 0;
+  }
+
+  bool fits(const Account& account, double size) const;
+
+public:
+  /**
+   * Time and size of some code the passes add, in the units of GCC's time and
+   * size estimates (about one per simple statement).
+   */
+  struct Cost {
+    double time = 0;
+    double size = 0;
+  };
+
+  /**
+   * What the code the passes add costs on a target, from the target's RTL
+   * costs, see costs().
+   */
+  struct Costs {
+    // An opaque predicate: loading x and y, evaluating it and the branch,
+    // its size with the junk block's jump. Cached x and y need no loads.
+    Cost guard;
+    Cost cached_guard;
+    // Storing the next state and jumping back to the dispatch.
+    Cost transition;
+    // Dispatching: a level of the switch's tree of compares, or the decode,
+    // the load and the indirect jump of the table.
+    Cost compare;
+    Cost lookup;
+    // A string's check, its size with its decrypt and wait loops.
+    Cost check;
+    // The longest decode of a constant, with the load of the opaque 0.
+    Cost decode;
+  };
+
+  explicit Budget(double maxOverhead = 0, double maxGrowth = 0, double maxTUGrowth = 0,
+                  uint32_t perFLA = 100, uint32_t perBCF = 100, uint32_t perSUB = 100)
+    : mMaxOverhead(maxOverhead), mMaxGrowth(maxGrowth), mMaxTUGrowth(maxTUGrowth),
+      mPerFLA(perFLA), mPerBCF(perBCF), mPerSUB(perSUB) {
+  }
+
+  bool enabled() const {
+    return time_enabled() || size_enabled();
+  }
+
+  /**
+   * Price the code the passes add with the target's RTL costs, for f's target
+   * options, so e.g.: a guard is as expensive as the target's loads, compares
+   * and branches make it.
+   *
+   * @param f function being transformed
+   * @param mode mode the code computes in, e.g.: int's for guards and states
+   * @return the costs, computed once per target options and mode
+   */
+  const Costs& costs(function* f, machine_mode mode);
+
+  /**
+   * Draw whether a candidate of a pass is picked, according to perFLA, ...
+   *
+   * @param pass name of the pass, e.g.: "bcf"
+   * @param random stream of the pass
+   * @return true if the candidate should be transformed
+   */
+  bool pick(const char* pass, Random::Stream& random) const;
+
+  /**
+   * Take the cost and size of a function before the passes change it, and
+   * its size again before every other pass.
+   *
+   * @param f function about to be transformed
+   */
+  void begin(function* f);
+
+  /**
+   * @param f function being transformed
+   * @param size size of the code about to be added
+   * @return true if the size budget has room for it, e.g.: to fall back to
+   *         smaller rewrites once it runs low
+   */
+  bool fits(function* f, double size) const;
+
+  /**
+   * Charge the overhead of a transformation if the function can afford it.
+   *
+   * @param f function being transformed
+   * @param bb block the added code executes in
+   * @param cost time of the added code per execution
+   * @param size size of the added code
+   * @return false if it would exceed a limit, nothing is charged then
+   */
+  bool charge(function* f, basic_block bb, double cost, double size);
+
+  bool charge(function* f, basic_block bb, const Cost& cost) {
+    return charge(f, bb, cost.time, cost.size);
+  }
+
+  /**
+   * Print the functions which used up their size budget.
+   */
+  void report(std::ostream& out) const;
+};
@@ -0,0 +1,272 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "CON.h"
+#include "Attributes.h"
+#include "Loops.h"
+#include "Opaque.h"
+
+#include <function.h>
+#include <tree.h>
+#include <basic-block.h>
+#include <tree-cfg.h>
+
+#include <gimple-expr.h>
+#include <gimple.h>
+#include <gimple-iterator.h>
+#include <ssa.h>
+#include <tree-into-ssa.h>
+
+#include <cfgloop.h>
+#include <cfgloopmanip.h>
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+/**
+ * @return true if op is a constant worth encoding
+ */
+static bool is_candidate_constant(tree op) {
+  if (TREE_CODE(op) != INTEGER_CST) return false;
+
+  // Booleans, pointers, enums and bit-fields are left alone, and so are 0 and
+  // 1, which are everywhere and give nothing away.
+  tree type = TREE_TYPE(op);
+  if (TREE_CODE(type) != INTEGER_TYPE || !type_has_mode_precision_p(type)) return false;
+  if (TYPE_PRECISION(type) > HOST_BITS_PER_WIDE_INT) return false;
+
+  return !integer_zerop(op) && !integer_onep(op);
+}
+
+/**
+ * Collect the operands of stmt which are encoded. Multiplications, divisions
+ * and shifts keep their constants, as do switch cases, which must be constant.
+ *
+ * @param stmt statement
+ * @param loop innermost loop of the statement, or nullptr
+ * @param operands set to the operand indices
+ */
+static void candidate_operands(gimple* stmt, loop_p loop, std::vector<unsigned>* operands) {
+  operands->clear();
+
+  if (gimple_code(stmt) == GIMPLE_COND) {
+    for (unsigned i = 0; i < 2; i++) {
+      if (is_candidate_constant(gimple_op(stmt, i))) operands->push_back(i);
+    }
+    return;
+  }
+
+  if (!is_gimple_assign(stmt)) return;
+
+  tree_code code = gimple_assign_rhs_code(stmt);
+  if (code != INTEGER_CST && code != PLUS_EXPR && code != MINUS_EXPR &&
+      code != BIT_AND_EXPR && code != BIT_IOR_EXPR && code != BIT_XOR_EXPR &&
+      code != MIN_EXPR && code != MAX_EXPR && TREE_CODE_CLASS(code) != tcc_comparison) {
+    return;
+  }
+
+  // Keep induction variables and reductions analyzable, a step in a register
+  // hides the trip count from the unroller and the vectorizer.
+  if (loop && code != INTEGER_CST && is_loop_carried(stmt, loop)) return;
+
+  for (unsigned i = 1; i < gimple_num_ops(stmt); i++) {
+    if (is_candidate_constant(gimple_op(stmt, i))) operands->push_back(i);
+  }
+}
+
+/**
+ * @return a new register of the given type
+ */
+static tree make_reg(tree type, bool in_ssa) {
+  return in_ssa ? make_ssa_name(type) : create_tmp_reg(type, "con");
+}
+
+/**
+ * @return the block a constant used in bb is decoded in: the preheader of the
+ *         outermost loop bb is in, or nullptr for the function entry
+ */
+static basic_block decode_block(function* f, basic_block bb, bool loops) {
+  if (!loops) return nullptr;
+
+  loop_p loop = bb->loop_father;
+  if (!loop || !loop_outer(loop)) return nullptr;
+
+  while (loop_outer(loop_outer(loop))) loop = loop_outer(loop);
+
+  // Loops entered through abnormal edges have no preheader, entry dominates
+  // them as well.
+  edge preheader = loop_preheader_edge(loop);
+  if ((preheader->flags & EDGE_COMPLEX) || !single_succ_p(preheader->src) ||
+      preheader->src == ENTRY_BLOCK_PTR_FOR_FN(f)) {
+    return nullptr;
+  }
+
+  return preheader->src;
+}
+
+/**
+ * Emit the decoding of a constant at the end of a block.
+ *
+ * @param gsi end of the block
+ * @param zero register holding the opaque 0
+ * @param value constant
+ * @param random key stream
+ * @param in_ssa whether the function is in SSA form
+ * @return the register holding value
+ */
+static tree emit_decode(gimple_stmt_iterator* gsi, tree zero, tree value,
+                        Random::Stream& random, bool in_ssa) {
+  tree type = TREE_TYPE(value);
+  // Decode in the unsigned type, overflow is the point.
+  tree work = unsigned_type_for(type);
+
+  auto key = [&]() {
+    uint64_t k = (uint32_t) random.nextInt();
+    k = k << 32 | (uint32_t) random.nextInt();
+    return build_int_cst_type(work, (HOST_WIDE_INT) k);
+  };
+  auto emit = [&](tree_code code, tree op1, tree op2) {
+    tree reg = make_reg(work, in_ssa);
+    gsi_insert_after(gsi, gimple_build_assign(reg, code, op1, op2), GSI_NEW_STMT);
+    return reg;
+  };
+
+  tree z = make_reg(work, in_ssa);
+  gsi_insert_after(gsi, gimple_build_assign(z, NOP_EXPR, zero), GSI_NEW_STMT);
+
+  tree c = fold_convert(work, value);
+  tree k1 = key();
+  tree result;
+  switch ((uint32_t) random.nextInt() % 3) {
+  case 0:
+    // (k1 + z) ^ (k1 ^ c)
+    result = emit(BIT_XOR_EXPR, emit(PLUS_EXPR, k1, z),
+                  fold_build2(BIT_XOR_EXPR, work, k1, c));
+    break;
+  case 1:
+    // (k1 ^ z) - (k1 - c)
+    result = emit(MINUS_EXPR, emit(BIT_XOR_EXPR, k1, z),
+                  fold_build2(MINUS_EXPR, work, k1, c));
+    break;
+  default: {
+    // a + b as (a ^ b) + 2 * (a & b), with a = k1 + z and b = (c - k1) + z
+    tree a = emit(PLUS_EXPR, k1, z);
+    tree b = emit(PLUS_EXPR, fold_build2(MINUS_EXPR, work, c, k1), z);
+    tree x = emit(BIT_XOR_EXPR, a, b);
+    tree y = emit(LSHIFT_EXPR, emit(BIT_AND_EXPR, a, b), build_int_cst(integer_type_node, 1));
+    result = emit(PLUS_EXPR, x, y);
+    break;
+  }
+  }
+
+  if (useless_type_conversion_p(type, work)) return result;
+
+  tree reg = make_reg(type, in_ssa);
+  gsi_insert_after(gsi, gimple_build_assign(reg, NOP_EXPR, result), GSI_NEW_STMT);
+  return reg;
+}
+
+unsigned int CONPass::execute(function* f) {
+  if (!hellscape_enabled(f, "con", mEnable)) return 0;
+
+  auto_client_timevar timevar("hellscape: con");
+  mBudget.begin(f);
+  Stats::Record record(mStats, f, "con");
+  Random::Stream random = mRandom.stream(hellscape_symbol(f).c_str(), "con");
+
+  bool in_ssa = gimple_in_ssa_p(f);
+
+  // Decodes go into the preheaders. Outside of the loop optimizer loops may
+  // have several latches and no preheader, loop_optimizer_init merges the
+  // latches and adds the preheaders (loop_preheader_edge relies on both).
+  bool loops = update_loops(f);
+  if (loops) loop_optimizer_init(LOOPS_NORMAL);
+
+  struct Site {
+    gimple* stmt;
+    unsigned operand;
+  };
+  std::vector<Site> sites;
+  std::vector<unsigned> operands;
+  basic_block bb;
+  FOR_EACH_BB_FN(bb, f) {
+    loop_p loop = loops ? innermost_loop(bb) : nullptr;
+
+    for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+      candidate_operands(gsi_stmt(gsi), loop, &operands);
+      for (unsigned i : operands) sites.push_back({gsi_stmt(gsi), i});
+    }
+  }
+
+  if (sites.empty()) {
+    if (loops) loop_optimizer_finalize();
+    return 0;
+  }
+
+  // The opaque 0 is loaded once per decode block, each constant decoded once.
+  tree global = opaque_global("$x");
+  basic_block entry = nullptr;
+  std::map<basic_block, tree> zeros;
+  std::map<std::tuple<basic_block, tree, uint64_t>, tree> decoded;
+
+  for (auto& site : sites) {
+    tree value = gimple_op(site.stmt, site.operand);
+
+    basic_block block = decode_block(f, gimple_bb(site.stmt), loops);
+    if (!block) {
+      if (!entry) entry = split_edge(single_succ_edge(ENTRY_BLOCK_PTR_FOR_FN(f)));
+      block = entry;
+    }
+
+    auto key = std::make_tuple(block, TREE_TYPE(value), (uint64_t) TREE_INT_CST_LOW(value));
+    auto it = decoded.find(key);
+    if (it == decoded.end()) {
+      const Budget::Costs& costs = mBudget.costs(f, TYPE_MODE(TREE_TYPE(value)));
+      if (!mBudget.charge(f, block, costs.decode)) {
+        record.count("over_budget");
+        continue;
+      }
+
+      gimple_stmt_iterator gsi = gsi_last_bb(block);
+      tree& zero = zeros[block];
+      if (!zero) {
+        zero = make_reg(integer_type_node, in_ssa);
+        gsi_insert_after(&gsi, gimple_build_assign(zero, global), GSI_NEW_STMT);
+      }
+
+      it = decoded.emplace(key, emit_decode(&gsi, zero, value, random, in_ssa)).first;
+      record.count("decodes");
+    }
+
+    gimple_set_op(site.stmt, site.operand, it->second);
+    update_stmt(site.stmt);
+    record.count("constants");
+  }
+
+  if (loops) loop_optimizer_finalize();
+
+  if (!decoded.empty()) hellscape_done(f, "con");
+
+  // The loads of $x need virtual operands.
+  if (in_ssa) {
+    mark_virtual_operands_for_renaming(f);
+    return TODO_update_ssa_only_virtuals;
+  }
+
+  return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gcc-plugin.h>
+#include <tree-pass.h>
+#include <context.h>
+#include <function.h>
+
+#include "Random.h"
+#include "Stats.h"
+#include "Budget.h"
+
+const pass_data con_pass_data = {
+  GIMPLE_PASS,
+  "con",
+
+  OPTGROUP_NONE,
+  TV_PLUGIN_RUN,
+  PROP_gimple_any,
+  0, 0, 0, 0
+};
+
+/**
+ * Replaces integer constants with opaque expressions of random keys and a
+ * global nothing can prove is 0, e.g.: 0xbaaad0bf with (k1 + $x) ^ k2. Each
+ * constant is decoded once in the preheader of the outermost loop using it, or
+ * on function entry outside of loops, so it costs one computation per call
+ * rather than one per iteration. Shift amounts, divisors and multipliers are
+ * left alone, GCC needs those constant to strength-reduce them.
+ */
+struct CONPass : gimple_opt_pass {
+  Random& mRandom;
+  Stats& mStats;
+  Budget& mBudget;
+  bool mEnable;
+
+  CONPass(gcc::context* context, Random& random, Stats& stats, Budget& budget,
+          bool enable = true) : gimple_opt_pass(con_pass_data, context), mRandom(random),
+    mStats(stats), mBudget(budget), mEnable(enable) {
+  }
+
+  unsigned int execute(function* f) override;
+
+  CONPass* clone() override {
+    return this;
+  }
+};
@@ -0,0 +1,289 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Dump.h"
+
+#include <tree.h>
+#include <basic-block.h>
+#include <diagnostic-core.h>
+#include <timevar.h>
+
+#include <gimple.h>
+#include <gimple-pretty-print.h>
+#include <gimple-iterator.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fnmatch.h>
+#include <unistd.h>
+
+/**
+ * Write s escaped for an HTML-like DOT label.
+ */
+static void put_html(FILE* out, const char* s) {
+  for (const char* c = s; *c; c++) {
+    switch (*c) {
+    case '&':
+      fputs("&amp;", out);
+      break;
+    case '"':
+      fputs("&quot;", out);
+      break;
+    case '\'':
+      fputs("&apos;", out);
+      break;
+    case '<':
+      fputs("&lt;", out);
+      break;
+    case '>':
+      fputs("&gt;", out);
+      break;
+    case '\n':
+      fputs("<br/>", out);
+      break;
+    default:
+      fputc(*c, out);
+      break;
+    }
+  }
+}
+
+/**
+ * Write s as a JSON string, or the inside of a quoted DOT ID when dot is set.
+ */
+static void put_string(FILE* out, const char* s, bool dot = false) {
+  if (!dot) fputc('"', out);
+  for (const char* c = s; *c; c++) {
+    switch (*c) {
+    case '"':
+      fputs("\\\"", out);
+      break;
+    case '\\':
+      fputs("\\\\", out);
+      break;
+    case '\n':
+      fputs("\\n", out);
+      break;
+    default:
+      if (!dot && (unsigned char) *c < 0x20) {
+        fprintf(out, "\\u%04x", (unsigned) *c);
+      } else {
+        fputc(*c, out);
+      }
+    }
+  }
+  if (!dot) fputc('"', out);
+}
+
+/**
+ * @return the symbol name if it is known, the source name otherwise
+ */
+static const char* symbol_name(function* f) {
+  if (DECL_ASSEMBLER_NAME_SET_P(f->decl)) {
+    return IDENTIFIER_POINTER(DECL_ASSEMBLER_NAME(f->decl));
+  }
+
+  return function_name(f);
+}
+
+static const char* edge_kind(edge e) {
+  if (e->flags & EDGE_TRUE_VALUE) return "true";
+  if (e->flags & EDGE_FALSE_VALUE) return "false";
+  if (e->flags & EDGE_EH) return "eh";
+  if (e->flags & EDGE_ABNORMAL) return "abnormal";
+  return "normal";
+}
+
+/**
+ * Call fn with the text of every PHI node and statement of a block, the text
+ * is only valid during the call.
+ */
+template <typename Fn>
+static void for_each_stmt_text(pretty_printer* pp, basic_block bb, Fn fn) {
+  auto print = [&](gimple* gs) {
+    pp_gimple_stmt_1(pp, gs, 0, static_cast<dump_flags_t>(0));
+    fn(pp_formatted_text(pp));
+    pp_clear_output_area(pp);
+  };
+
+  for (gphi_iterator gsi = gsi_start_phis(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+    print(gsi.phi());
+  }
+  for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+    print(gsi_stmt(gsi));
+  }
+}
+
+Dump::~Dump() {
+  if (mFile) fclose(mFile);
+}
+
+void Dump::configure(Format format, std::string filter, std::string dir) {
+  mFormat = format;
+  mFilter = std::move(filter);
+  mDir = std::move(dir);
+}
+
+bool Dump::matches(function* f) const {
+  if (mFilter.empty()) return true;
+  if (fnmatch(mFilter.c_str(), function_name(f), 0) == 0) return true;
+
+  return DECL_ASSEMBLER_NAME_SET_P(f->decl) &&
+         fnmatch(mFilter.c_str(), IDENTIFIER_POINTER(DECL_ASSEMBLER_NAME(f->decl)), 0) == 0;
+}
+
+bool Dump::open() {
+  if (mFile) return true;
+  if (mFailed) return false;
+
+  // e.g.: dumps/target.c.1234.dot, the name is only known once the compiler
+  // runs, so the file is opened on the first dump.
+  const char* input = main_input_filename ? lbasename(main_input_filename) : "stdin";
+  mPath = mDir + "/" + input + "." + std::to_string(getpid()) +
+          (mFormat == FORMAT_DOT ? ".dot" : ".jsonl");
+
+  mFile = fopen(mPath.c_str(), "w");
+  if (!mFile) {
+    mFailed = true;
+    error("hellscape: cannot open dump %qs: %s", mPath.c_str(), xstrerror(errno));
+    return false;
+  }
+
+  setvbuf(mFile, nullptr, _IOFBF, 1 << 20);
+  return true;
+}
+
+bool Dump::close(std::string* error) {
+  if (!mFile) return true;
+
+  bool failed = ferror(mFile) != 0;
+  failed |= fclose(mFile) != 0;
+  mFile = nullptr;
+
+  if (failed) {
+    *error = "cannot write " + mPath + ": " + strerror(errno);
+    return false;
+  }
+
+  return true;
+}
+
+void Dump::write(function* f, const char* stage) {
+  if (!enabled() || !matches(f) || !open()) return;
+
+  if (mFormat == FORMAT_DOT) {
+    write_dot(f, stage);
+  } else {
+    write_json(f, stage);
+  }
+}
+
+void Dump::write_dot(function* f, const char* stage) {
+  // Graphviz renders every graph of the file, e.g.: dot -Tsvg -O target.c.1234.dot
+  fputs("digraph \"", mFile);
+  put_string(mFile, symbol_name(f), true);
+  fprintf(mFile, " %s\" {\nlabel=\"", stage);
+  put_string(mFile, function_name(f), true);
+  fprintf(mFile, " (%s)\";\nlabelloc=t;\n", stage);
+
+  pretty_printer pp;
+  basic_block bb;
+  FOR_ALL_BB_FN(bb, f) {
+    fprintf(mFile, "%d [shape=\"Mrecord\" fontname=\"Courier New\" label=<\n"
+                   "<table border=\"0\" cellborder=\"0\" cellpadding=\"3\">\n"
+                   "<tr><td align=\"center\" colspan=\"2\" bgcolor=\"grey\">%d</td></tr>\n",
+            bb->index, bb->index);
+
+    for_each_stmt_text(&pp, bb, [&](const char* text) {
+      fputs("<tr><td align=\"left\">", mFile);
+      put_html(mFile, text);
+      fputs("</td></tr>\n", mFile);
+    });
+
+    fputs("</table>\n>];\n", mFile);
+
+    edge e;
+    edge_iterator ei{};
+    FOR_EACH_EDGE(e, ei, bb->succs) {
+      const char* style;
+      if (e->flags & EDGE_TRUE_VALUE) {
+        style = "color=\"green\"";
+      } else if (e->flags & EDGE_FALSE_VALUE) {
+        style = "color=\"red\"";
+      } else if (e->flags & (EDGE_EH | EDGE_ABNORMAL)) {
+        style = "color=\"grey\" style=\"dashed\"";
+      } else {
+        style = "color=\"blue\"";
+      }
+
+      fprintf(mFile, "%d -> %d [%s];\n", bb->index, e->dest->index, style);
+    }
+  }
+
+  fputs("}\n", mFile);
+}
+
+void Dump::write_json(function* f, const char* stage) {
+  // e.g.: {"tu":"a.c","function":"f","symbol":"f","stage":"fla","blocks":[
+  //   {"index":2,"stmts":["x_1 = y_2 + 1;"],"succs":[[3,"true"],[4,"false"]]},...]}
+  fputs("{\"tu\":", mFile);
+  put_string(mFile, main_input_filename ? main_input_filename : "");
+  fputs(",\"function\":", mFile);
+  put_string(mFile, function_name(f));
+  fputs(",\"symbol\":", mFile);
+  put_string(mFile, symbol_name(f));
+  fputs(",\"stage\":", mFile);
+  put_string(mFile, stage);
+  fputs(",\"blocks\":[", mFile);
+
+  pretty_printer pp;
+  basic_block bb;
+  const char* separator = "";
+  FOR_ALL_BB_FN(bb, f) {
+    fprintf(mFile, "%s{\"index\":%d,\"stmts\":[", separator, bb->index);
+    separator = ",";
+
+    const char* stmt_separator = "";
+    for_each_stmt_text(&pp, bb, [&](const char* text) {
+      fputs(stmt_separator, mFile);
+      put_string(mFile, text);
+      stmt_separator = ",";
+    });
+
+    fputs("],\"succs\":[", mFile);
+
+    edge e;
+    edge_iterator ei{};
+    const char* edge_separator = "";
+    FOR_EACH_EDGE(e, ei, bb->succs) {
+      fprintf(mFile, "%s[%d,\"%s\"]", edge_separator, e->dest->index, edge_kind(e));
+      edge_separator = ",";
+    }
+
+    fputs("]}", mFile);
+  }
+
+  fputs("]}\n", mFile);
+}
+
+unsigned int DumpPass::execute(function* f) {
+  auto_client_timevar timevar("hellscape: dump");
+
+  mDump.write(f, mStage);
+  return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gcc-plugin.h>
+
+#include <tree-pass.h>
+#include <context.h>
+#include <function.h>
+
+#include <cstdio>
+#include <string>
+
+/**
+ * CFG dumps for -fplugin-arg-hellscape-dump=dot|json.
+ *
+ * Every translation unit streams into a single file in the dump directory,
+ * named after the main input file and the compiler's pid, so parallel builds
+ * and functions of the same name never overwrite each other. Statements are
+ * escaped straight into the file, dumping costs as much as the output it
+ * writes.
+ */
+class Dump {
+public:
+  enum Format {
+    FORMAT_NONE,
+    // One digraph per function and stage, with the statements as node labels.
+    FORMAT_DOT,
+    // One JSON line per function and stage.
+    FORMAT_JSON
+  };
+
+  Dump() = default;
+  ~Dump();
+
+  Dump(const Dump&) = delete;
+  Dump& operator=(const Dump&) = delete;
+
+  /**
+   * @param format output format, FORMAT_NONE disables the dumps
+   * @param filter fnmatch pattern for function or symbol names, empty for all
+   * @param dir directory for the dump files
+   */
+  void configure(Format format, std::string filter, std::string dir);
+
+  bool enabled() const {
+    return mFormat != FORMAT_NONE;
+  }
+
+  /**
+   * Dump the CFG of a function if it matches the filter.
+   *
+   * @param f function to dump
+   * @param stage what ran before, e.g.: "input" or "bcf"
+   */
+  void write(function* f, const char* stage);
+
+  /**
+   * Close the dump file.
+   *
+   * @param error set to the reason on failure
+   * @return false if the dump could not be written completely
+   */
+  bool close(std::string* error);
+
+private:
+  bool matches(function* f) const;
+  bool open();
+
+  void write_dot(function* f, const char* stage);
+  void write_json(function* f, const char* stage);
+
+  Format mFormat = FORMAT_NONE;
+  std::string mFilter;
+  std::string mDir = ".";
+
+  std::string mPath;
+  FILE* mFile = nullptr;
+  // Set once opening failed, so the error is reported a single time.
+  bool mFailed = false;
+};
+
+const pass_data dump_pass_data = {
+  GIMPLE_PASS,
+  "hsdump",
+
+  OPTGROUP_NONE,
+  TV_PLUGIN_RUN,
+  PROP_gimple_any,
+  0, 0, 0, 0
+};
+
+/**
+ * Dumps every function at one stage of the pipeline, only registered around
+ * the obfuscation passes when dumps are enabled.
+ */
+struct DumpPass : gimple_opt_pass {
+  Dump& mDump;
+  const char* mStage;
+
+  DumpPass(gcc::context* context, Dump& dump, const char* stage) : gimple_opt_pass(
+    dump_pass_data, context), mDump(dump), mStage(stage) {
+  }
+
+  unsigned int execute(function* f) override;
+
+  DumpPass* clone() override {
+    return this;
+  }
+};
@@ -16,6 +16,7 @@
  */
 
 #include "FLA.h"
+#include "Attributes.h"
 
 #include <basic-block.h>
 #include <tree.h>
@@ -24,49 +25,349 @@
 #include <gimple-expr.h>
 #include <gimple.h>
 #include <gimple-iterator.h>
-
+#include <ssa.h>
+#include <tree-into-ssa.h>
+#include <cfgloop.h>
+#include <cfgloopmanip.h>
+#include <cgraph.h>
+#include <dominance.h>
+
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <numeric>
 #include <vector>
-#include <unordered_map>
 
-#include "Viz.h"
+#include "Loops.h"
+
+// Most predecessors a block on the way back to the switch may have, this bounds
+// the size of the switchVar PHIs once the function is in SSA form.
+static const size_t FAN_IN = 32;
+
+/**
+ * Check for control flow which can't be routed through the switch, e.g.:
+ * setjmp receivers or non-local gotos.
+ *
+ * @param f function to check
+ * @return true if any edge is abnormal
+ */
+static bool has_abnormal_edges(function* f) {
+  basic_block bb;
+  FOR_ALL_BB_FN(bb, f) {
+    edge e;
+    edge_iterator ei{};
+    FOR_EACH_EDGE(e, ei, bb->succs) {
+      if (e->flags & EDGE_ABNORMAL) return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Once every edge goes through the switch no block dominates another, so values
+ * can no longer flow between blocks in SSA names. Replace PHI nodes with copies
+ * on their incoming edges, and SSA names used outside of their defining block
+ * with variables. update_ssa re-builds SSA form from those variables after the
+ * flattening.
+ *
+ * @param f function in SSA form
+ */
+static void demote_ssa(function* f) {
+  basic_block bb;
+  FOR_EACH_BB_FN(bb, f) {
+    for (gphi_iterator psi = gsi_start_phis(bb); !gsi_end_p(psi);) {
+      gphi* phi = psi.phi();
+      tree result = gimple_phi_result(phi);
+
+      // Memory is renamed from scratch afterwards.
+      if (virtual_operand_p(result)) {
+        mark_virtual_phi_result_for_renaming(phi);
+        remove_phi_node(&psi, true);
+        continue;
+      }
+
+      tree var = create_tmp_reg(TREE_TYPE(result), "phi");
+      for (unsigned i = 0; i < gimple_phi_num_args(phi); i++) {
+        gsi_insert_on_edge(gimple_phi_arg_edge(phi, i),
+                           gimple_build_assign(var, gimple_phi_arg_def(phi, i)));
+      }
+
+      // result = phi, re-defines the name so its uses are untouched.
+      gimple_stmt_iterator gsi = gsi_after_labels(bb);
+      gsi_insert_before(&gsi, gimple_build_assign(result, var), GSI_NEW_STMT);
+      remove_phi_node(&psi, false);
+    }
+  }
+
+  unsigned i;
+  tree name;
+  FOR_EACH_SSA_NAME(i, name, f) {
+    if (virtual_operand_p(name) || SSA_NAME_IS_DEFAULT_DEF(name)) continue;
+
+    gimple* def = SSA_NAME_DEF_STMT(name);
+    basic_block def_bb = gimple_bb(def);
+    if (!def_bb) continue;
+
+    tree var = NULL_TREE;
+    gimple* use_stmt;
+    imm_use_iterator iter;
+    FOR_EACH_IMM_USE_STMT(use_stmt, iter, name) {
+      if (gimple_bb(use_stmt) == def_bb) continue;
+
+      if (is_gimple_debug(use_stmt)) {
+        gimple_debug_bind_reset_value(use_stmt);
+        update_stmt(use_stmt);
+        continue;
+      }
+
+      // Spill the value right after its definition, or on the fallthrough if
+      // the definition ends the block (a call that can throw).
+      if (var == NULL_TREE) {
+        var = create_tmp_reg(TREE_TYPE(name), "ssa");
+        gimple* store = gimple_build_assign(var, name);
+
+        if (stmt_ends_bb_p(def)) {
+          gsi_insert_on_edge(find_fallthru_edge(def_bb->succs), store);
+        } else {
+          gimple_stmt_iterator def_gsi = gsi_for_stmt(def);
+          gsi_insert_after(&def_gsi, store, GSI_NEW_STMT);
+        }
+      }
+
+      // Reload it in front of the use.
+      tree copy = make_ssa_name(TREE_TYPE(name));
+      gimple_stmt_iterator use_gsi = gsi_for_stmt(use_stmt);
+      gsi_insert_before(&use_gsi, gimple_build_assign(copy, var), GSI_SAME_STMT);
+
+      use_operand_p use_p;
+      FOR_EACH_IMM_USE_ON_STMT(use_p, iter) {
+        SET_USE(use_p, copy);
+      }
+      update_stmt(use_stmt);
+    }
+  }
+
+  gsi_commit_edge_inserts();
+}
+
+/**
+ * Mark the blocks of innermost loops, which region mode leaves alone so they
+ * can still be unrolled, vectorized, etc.
+ *
+ * @param f function to flatten
+ * @param in_kept_loop set for every block of an innermost loop, by block index
+ */
+static void find_innermost_loops(function* f, std::vector<bool>* in_kept_loop) {
+  // An earlier pass may have left the loop tree to be fixed up.
+  if (!update_loops(f)) return;
+
+  basic_block bb;
+  FOR_EACH_BB_FN(bb, f) {
+    if (innermost_loop(bb)) (*in_kept_loop)[bb->index] = true;
+  }
+}
+
+/**
+ * Bring the dominators up to date after flattening. Blocks only reached from
+ * the switch are dominated by it, the dominators of blocks which kept some of
+ * their incoming edges are worked out from those edges, and the blocks added
+ * on the way back to the switch are dominated by what they join.
+ *
+ * @param f flattened function
+ * @param blocks indices of the blocks which were flattened or kept
+ * @param initialization_block block setting the first state
+ * @param switch_block block dispatching to the blocks
+ * @param joins every other block the flattening added and the exit block,
+ *              each after its predecessors
+ */
+static void update_dominators(function* f, const std::vector<int>& blocks,
+                              basic_block initialization_block, basic_block switch_block,
+                              const std::vector<basic_block>& joins) {
+  set_immediate_dominator(CDI_DOMINATORS, switch_block, initialization_block);
+
+  auto_vec<basic_block> kept;
+  for (int i : blocks) {
+    basic_block bb = BASIC_BLOCK_FOR_FN(f, i);
+    if (single_pred_p(bb) && single_pred(bb) == switch_block) {
+      set_immediate_dominator(CDI_DOMINATORS, bb, switch_block);
+    } else {
+      kept.safe_push(bb);
+    }
+  }
+
+  if (!kept.is_empty()) iterate_fix_dominators(CDI_DOMINATORS, kept, false);
+
+  for (basic_block bb : joins) {
+    if (EDGE_COUNT(bb->preds) == 0) continue;
+
+    set_immediate_dominator(CDI_DOMINATORS, bb, recompute_dominator(CDI_DOMINATORS, bb));
+  }
+}
+
+/**
+ * Set the count of a block the flattening added to what its incoming edges
+ * bring.
+ */
+static void sum_incoming_counts(basic_block bb) {
+  profile_count count = profile_count::zero();
+  edge e;
+  edge_iterator ei{};
+  FOR_EACH_EDGE(e, ei, bb->preds) count += e->count();
+  bb->count = count;
+}
+
+/**
+ * @param a odd number
+ * @return the multiplicative inverse of a modulo 2^32
+ */
+static uint32_t inverse(uint32_t a) {
+  // Newton's iteration, a * a = 1 mod 8 and every step doubles the correct bits.
+  uint32_t x = a;
+  for (int i = 0; i < 4; i++) {
+    x *= 2 - a * x;
+  }
+
+  return x;
+}
+
+/**
+ * Declare the table of a threaded dispatch, a static of f holding the address
+ * of the block for every index, e.g.: static void* dispatch[] = {&&l2, &&l5}.
+ *
+ * @param f function being flattened
+ * @param labels label of the block of each index
+ * @return the declaration
+ */
+static tree create_dispatch_table(function* f, const std::vector<tree>& labels) {
+  tree type = build_array_type_nelts(ptr_type_node, labels.size());
+
+  vec<constructor_elt, va_gc>* elements = nullptr;
+  for (size_t i = 0; i < labels.size(); i++) {
+    // Taking the address keeps the block from being merged or removed.
+    FORCED_LABEL(labels[i]) = 1;
+    CONSTRUCTOR_APPEND_ELT(elements, size_int(i),
+                           build_fold_addr_expr_with_type(labels[i], ptr_type_node));
+  }
+
+  tree init = build_constructor(type, elements);
+  TREE_CONSTANT(init) = 1;
+  TREE_STATIC(init) = 1;
+
+  tree table = build_decl(DECL_SOURCE_LOCATION(f->decl), VAR_DECL,
+                          create_tmp_var_name("dispatch"), type);
+  TREE_STATIC(table) = 1;
+  TREE_READONLY(table) = 1;
+  TREE_USED(table) = 1;
+  DECL_ARTIFICIAL(table) = 1;
+  DECL_IGNORED_P(table) = 1;
+  DECL_CONTEXT(table) = f->decl;
+  DECL_INITIAL(table) = init;
+  add_local_decl(f, table);
+  varpool_node::add(table);
+
+  // A copy of f would jump into the original, it must not be inlined or cloned.
+  f->has_forced_label_in_static = 1;
+  return table;
+}
 
 unsigned int FLAPass::execute(function* f) {
-  if (!mEnable) return 0;
+  if (!hellscape_enabled(f, "fla", mEnable)) return 0;
+
+  auto_client_timevar timevar("hellscape: fla");
 
   // If there's only one block... not much to do.
   if (f->cfg->x_n_basic_blocks <= 3) {
     return 0;
   }
 
-  std::unordered_map<int, uint32_t> block_to_rnd;
+  if (has_abnormal_edges(f)) {
+    return 0;
+  }
+
+  mBudget.begin(f);
+  Stats::Record record(mStats, f, "fla");
+
+  bool in_ssa = gimple_in_ssa_p(f);
+  if (in_ssa) {
+    demote_ssa(f);
+  }
+
   std::vector<int> collected_blocks;
 
   // For all basic blocks SKIPPING the special entry and the special exit.
   for (basic_block bb = ENTRY_BLOCK_PTR_FOR_FN(f)->next_bb;
        bb && bb->next_bb; bb = bb->next_bb) {
     collected_blocks.push_back(bb->index);
+  }
+
+  // Blocks of innermost loops which are kept intact in region mode.
+  std::vector<bool> in_kept_loop(last_basic_block_for_fn(f), false);
+  if (mRegion) {
+    find_innermost_loops(f, &in_kept_loop);
+  }
 
-    // Generate a positive random number and ensure it is not already used.
-redo:
-    auto n = (uint32_t) std::abs(mRandom.nextInt());
-    for (auto e : block_to_rnd) {
-      if (e.second == n) goto redo;
+  Random::Stream random = mRandom.stream(hellscape_symbol(f).c_str(), "fla");
+
+  // Keep the dominators (if there are any) and the loop tree up to date, so
+  // the passes after this one do not have to recompute them.
+  bool loops = current_loops && !loops_state_satisfies_p(f, LOOPS_NEED_FIXUP);
+  // add_loop finds the body of the new loop through the dominators, which is
+  // still cheaper than rediscovering every loop in a fixup.
+  if (loops) calculate_dominance_info(CDI_DOMINATORS);
+  bool dominators = dom_info_available_p(f, CDI_DOMINATORS);
+
+  // Removing an edge inside a loop breaks the loop up, the loop tree has to be
+  // rediscovered then. Loops only left or entered through the switch survive.
+  auto unlink = [&](edge e) {
+    if (loops && loop_outer(find_common_loop(e->src->loop_father, e->dest->loop_father))) {
+      loops = false;
     }
+    remove_edge(e);
+  };
+
+  // Give every block a distinct positive case value: a random permutation of
+  // the blocks pushed through x -> (a * x + b) mod 2^31, a bijection for odd a.
+  std::vector<uint32_t> order(collected_blocks.size());
+  std::iota(order.begin(), order.end(), 0);
+  for (size_t i = order.size(); i > 1; i--) {
+    std::swap(order[i - 1], order[(uint32_t) random.nextInt() % i]);
+  }
 
-    block_to_rnd[bb->index] = n;
+  uint32_t multiplier = (uint32_t) random.nextInt() | 1;
+  uint32_t offset = (uint32_t) random.nextInt();
+
+  // In table mode the permutation itself is the (dense) case value and the
+  // states are its full 32 bit image, decoded again in front of the switch.
+  // Threaded mode decodes the same way, into an index of the label table.
+  bool table = mDispatch != DISPATCH_SWITCH;
+  bool threaded = mDispatch == DISPATCH_THREADED;
+  tree state_type = table ? unsigned_type_node : integer_type_node;
+
+  std::vector<uint32_t> block_to_rnd(last_basic_block_for_fn(f));
+  std::vector<uint32_t> block_to_case(last_basic_block_for_fn(f));
+  for (size_t i = 0; i < collected_blocks.size(); i++) {
+    uint32_t state = multiplier * order[i] + offset;
+    block_to_rnd[collected_blocks[i]] = table ? state : state & 0x7fffffff;
+    block_to_case[collected_blocks[i]] = table ? order[i] : state & 0x7fffffff;
   }
 
+  // Blocks which the switch has to be able to reach: the first block and every
+  // destination of a flattened edge.
+  std::vector<bool> dispatched(last_basic_block_for_fn(f), false);
+
   // Create the switchVar, used to denote the next destination
-  tree switchVar = create_tmp_var(integer_type_node, "switchVar");
+  tree switchVar = create_tmp_var(state_type, "switchVar");
 
   basic_block entry_block = ENTRY_BLOCK_PTR_FOR_FN(f);
   // Initialize the switchVar to the entry block.
   basic_block initialization_block = split_edge(EDGE_SUCC(entry_block, 0));
   gimple_stmt_iterator init_gsi = gsi_last_bb(initialization_block);
+  basic_block first_block = single_succ_edge(initialization_block)->dest;
+  dispatched[first_block->index] = true;
   // Set switchVar = <entry>.
   gsi_insert_after(&init_gsi, gimple_build_assign(switchVar, build_int_cst(
-    integer_type_node, block_to_rnd[single_succ_edge(initialization_block)->dest->index])),
+    state_type, block_to_rnd[first_block->index])),
                    GSI_NEW_STMT);
 
   // Entry -> switchVar = <first> -> switch -> <first>, etc.
@@ -76,6 +377,22 @@ redo:
   // lowering occurs.
   gsi_insert_after(&switch_gsi, gimple_build_nop(), GSI_NEW_STMT);
 
+  // A transition stores the state, jumps back and dispatches: a tree of
+  // compares or the decode and an indirect jump.
+  const Budget::Costs& costs = mBudget.costs(f, TYPE_MODE(state_type));
+  Budget::Cost transition = costs.transition;
+  transition.time += table ? costs.lookup.time
+                           : log2(collected_blocks.size() + 1) * costs.compare.time;
+
+  // Profiler mode counts every dispatch and what the budget charged for it.
+  // An earlier pass's attach becomes a flattened block, which only runs after
+  // the first dispatch.
+  if (mInstrument.enabled()) {
+    tree counters = mInstrument.counters(f, true);
+    mInstrument.count(f, &switch_gsi, counters, Instrument::DISPATCHES);
+    mInstrument.count_cost(f, &switch_gsi, counters, transition.time);
+  }
+
   // Create a return block which simply branches back to the switch.
   basic_block return_block = split_edge(single_succ_edge(switch_block));
   gimple_stmt_iterator ret_gsi = gsi_last_bb(return_block);
@@ -89,15 +406,32 @@ redo:
   gimple_stmt_iterator dummy_gsi = gsi_last_bb(dummy_block);
   gsi_insert_after(&dummy_gsi, gimple_build_nop(), GSI_NEW_STMT);
   redirect_edge_succ(EDGE_SUCC(dummy_block, 0), return_block);
+  Profile::mark_cold(f, dummy_block);
 
   tree default_lab = build_case_label(NULL_TREE, NULL_TREE,
                                       gimple_block_label(dummy_block));
 
+  // Blocks which now need a way back to the switch.
+  std::vector<basic_block> flattened_blocks;
+
+  // Blocks added behind the dispatch, in the order their dominators are known.
+  std::vector<basic_block> joins = {dummy_block};
+
+  // Blocks the budget cannot afford (or perFLA does not pick) keep their
+  // edges like hot ones.
+  auto afford = [&](basic_block bb) {
+    if (!mBudget.pick("fla", random)) return false;
+    if (mBudget.charge(f, bb, transition)) return true;
+
+    record.count("over_budget");
+    return false;
+  };
+
   // Labels MUST be sorted in GIMPLE. Must not include the default case label.
   auto_vec<tree> case_label_vec;
   case_label_vec.create(collected_blocks.size());
 
-  // Add all blocks to the switch.
+  // Re-route all flattened blocks through the switch.
   for (auto& bbi : collected_blocks) {
     basic_block target = BASIC_BLOCK_FOR_FN(f, bbi);
 
@@ -112,7 +446,12 @@ redo:
       last = NULL;
     }
 
-    if (last->code == GIMPLE_COND) {
+    // Hot blocks and innermost loops keep their edges, they stay reachable from
+    // the switch.
+    bool hot = mProfile.is_hot(target) || in_kept_loop[bbi];
+    bool flattened = false;
+
+    if (!hot && last && last->code == GIMPLE_COND && afford(target)) {
       auto* condptr = (gcond*) last;
       // Extract the condition and place it into a condition expression which
       // is assigned to the switchVar.
@@ -127,64 +466,235 @@ redo:
       edge false_e;
       extract_true_false_edges_from_block(target, &true_e, &false_e);
 
+      // Evaluate the condition on its own, a COND_EXPR does not take an
+      // embedded comparison in SSA form.
+      tree cond = create_tmp_reg(boolean_type_node, "cond");
+      gsi_insert_before(&last_gsi, gimple_build_assign(cond, cond_code, lhs, rhs),
+                        GSI_SAME_STMT);
+
       // Make a destination conditional, e.g.: switchVar = condition ? trueI : falseI.
-      tree destination = build3(COND_EXPR, integer_type_node,
-                                build2(cond_code, boolean_type_node, lhs,
-                                       rhs), build_int_cst(integer_type_node,
-                                                           block_to_rnd[true_e->dest->index]),
-                                build_int_cst(integer_type_node,
-                                              block_to_rnd[false_e->dest->index]));
+      gimple* assign = gimple_build_assign(switchVar, COND_EXPR, cond,
+                                           build_int_cst(state_type,
+                                                         block_to_rnd[true_e->dest->index]),
+                                           build_int_cst(state_type,
+                                                         block_to_rnd[false_e->dest->index]));
       // Remove the if statement, replace it with the destination assignment.
-      gimple* assign = gimple_build_assign(switchVar, destination);
       gimple_set_bb(assign, target);
       gsi_set_stmt(&last_gsi, assign);
 
+      dispatched[true_e->dest->index] = true;
+      dispatched[false_e->dest->index] = true;
+
       // Remove all outbound edges and replace them with a connection back to the switch.
-      remove_edge(true_e);
-      remove_edge(false_e);
-      make_edge(target, return_block, EDGE_FALLTHRU);
-    } else {
+      unlink(true_e);
+      unlink(false_e);
+      flattened_blocks.push_back(target);
+      flattened = true;
+    } else if (!hot && single_succ_p(target) && !(last && stmt_ends_bb_p(last))) {
       // It's not a conditional, re-route the fallthrough case to an assignment.
       gimple_stmt_iterator target_gsi = gsi_last_bb(target);
       edge fall_e = single_succ_edge(target);
 
       // If it is NOT pointing to the exit block, flatten.
-      if (fall_e->dest->index != 1 /* BLOCK_EXIT */) {
+      if (fall_e->dest != EXIT_BLOCK_PTR_FOR_FN(f) && afford(target)) {
         gimple* assign = gimple_build_assign(switchVar,
-                                             build_int_cst(integer_type_node,
+                                             build_int_cst(state_type,
                                                            block_to_rnd[fall_e->dest->index]));
         gimple_set_bb(assign, target);
         gsi_insert_after(&target_gsi, assign, GSI_NEW_STMT);
-        remove_edge(fall_e);
-        make_edge(target, return_block, EDGE_FALLTHRU);
+
+        dispatched[fall_e->dest->index] = true;
+
+        unlink(fall_e);
+        flattened_blocks.push_back(target);
+        flattened = true;
+      }
+    }
+    // Anything else (switches, EH edges) keeps its edges as well.
+
+    mProfile.account("fla", target, flattened);
+  }
+
+  // Leave kept loops through the switch as well, so each one becomes a single
+  // node of the flattened function.
+  if (mRegion) {
+    std::vector<edge> exits;
+    for (auto& bbi : collected_blocks) {
+      if (!in_kept_loop[bbi]) continue;
+
+      basic_block bb = BASIC_BLOCK_FOR_FN(f, bbi);
+      edge e;
+      edge_iterator ei{};
+      FOR_EACH_EDGE(e, ei, bb->succs) {
+        if (e->dest->loop_father != bb->loop_father &&
+            e->dest != EXIT_BLOCK_PTR_FOR_FN(f) && !(e->flags & EDGE_COMPLEX)) {
+          exits.push_back(e);
+        }
+      }
+    }
+
+    for (edge e : exits) {
+      basic_block dest = e->dest;
+      basic_block exit_block = split_edge(e);
+      gimple_stmt_iterator exit_gsi = gsi_last_bb(exit_block);
+      gsi_insert_after(&exit_gsi, gimple_build_assign(switchVar, build_int_cst(
+        state_type, block_to_rnd[dest->index])), GSI_NEW_STMT);
+
+      dispatched[dest->index] = true;
+
+      unlink(single_succ_edge(exit_block));
+      flattened_blocks.push_back(exit_block);
+      joins.push_back(exit_block);
+    }
+  }
+
+  // Connect the flattened blocks back to the switch through a tree of merge
+  // blocks rather than a single join with an edge (and after into-SSA, a PHI
+  // argument) per block, which later passes handle badly.
+  std::vector<basic_block> level = std::move(flattened_blocks);
+  while (level.size() > FAN_IN) {
+    std::vector<basic_block> next;
+
+    for (size_t i = 0; i < level.size(); i += FAN_IN) {
+      basic_block merge_block = create_empty_bb(return_block);
+      if (current_loops) add_bb_to_loop(merge_block, return_block->loop_father);
+
+      // Keep the block from being cleaned up as a forwarder before into-SSA.
+      gimple_stmt_iterator merge_gsi = gsi_last_bb(merge_block);
+      gsi_insert_after(&merge_gsi, gimple_build_nop(), GSI_NEW_STMT);
+
+      for (size_t j = i; j < std::min(i + FAN_IN, level.size()); j++) {
+        make_edge(level[j], merge_block, EDGE_FALLTHRU)->probability = profile_probability::always();
       }
+
+      next.push_back(merge_block);
+      joins.push_back(merge_block);
     }
 
+    level.swap(next);
+  }
+
+  for (basic_block bb : level) {
+    make_edge(bb, return_block, EDGE_FALLTHRU)->probability = profile_probability::always();
+  }
+
+  // Add all dispatched blocks to the switch.
+  for (auto& bbi : collected_blocks) {
+    if (!dispatched[bbi]) continue;
+
     tree lab = build_case_label(
-      build_int_cst(integer_type_node, block_to_rnd[bbi]), NULL,
-      gimple_block_label(target));
+      build_int_cst(state_type, block_to_case[bbi]), NULL,
+      gimple_block_label(BASIC_BLOCK_FOR_FN(f, bbi)));
     case_label_vec.quick_push(lab);
   }
 
-  // IR requires that the labels are sorted.
-  sort_case_labels(case_label_vec);
-  gsi_insert_after(&switch_gsi, gimple_build_switch(switchVar, default_lab,
-                                                    case_label_vec),
-                   GSI_NEW_STMT);
+  // Decode the state, index = (switchVar - offset) * multiplier^-1 mod 2^32.
+  tree index = switchVar;
+  if (table) {
+    tree delta = create_tmp_reg(state_type, "state");
+    gsi_insert_after(&switch_gsi, gimple_build_assign(delta, MINUS_EXPR, switchVar,
+                                                      build_int_cst(state_type, offset)),
+                     GSI_NEW_STMT);
+
+    index = create_tmp_reg(state_type, "index");
+    gsi_insert_after(&switch_gsi, gimple_build_assign(index, MULT_EXPR, delta,
+                                                      build_int_cst(state_type,
+                                                                    inverse(multiplier))),
+                     GSI_NEW_STMT);
+  }
+
+  record.count("cases", case_label_vec.length());
+
+  if (threaded) {
+    // goto *dispatch[index], an index no state decodes to leads to the dummy
+    // block. Keeping a single computed goto here keeps the CFG linear in the
+    // number of blocks, GCC duplicates it into every predecessor later
+    // (pass_duplicate_computed_gotos, at -O2 and above).
+    std::vector<tree> labels(collected_blocks.size(), gimple_block_label(dummy_block));
+    for (auto& bbi : collected_blocks) {
+      if (!dispatched[bbi]) continue;
 
-  // Send the default case to the dummy block for an infinite loop.
+      labels[block_to_case[bbi]] = gimple_block_label(BASIC_BLOCK_FOR_FN(f, bbi));
+    }
+    tree dispatch_table = create_dispatch_table(f, labels);
+
+    tree destination = create_tmp_reg(ptr_type_node, "destination");
+    gsi_insert_after(&switch_gsi, gimple_build_assign(destination, build4(
+      ARRAY_REF, ptr_type_node, dispatch_table, index, NULL_TREE, NULL_TREE)), GSI_NEW_STMT);
+    gsi_insert_after(&switch_gsi, gimple_build_goto(destination), GSI_NEW_STMT);
+  } else {
+    // IR requires that the labels are sorted.
+    sort_case_labels(case_label_vec);
+    gsi_insert_after(&switch_gsi, gimple_build_switch(index, default_lab,
+                                                      case_label_vec),
+                     GSI_NEW_STMT);
+  }
+
+  // Send the default case to the dummy block for an infinite loop, no state
+  // ever gets there. The edges of a computed goto are abnormal.
+  int dispatch_flags = threaded ? EDGE_ABNORMAL : 0;
   redirect_edge_succ(EDGE_SUCC(switch_block, 0), dummy_block);
-  EDGE_SUCC(switch_block, 0)->flags = 0;
-  EDGE_SUCC(switch_block,
-            0)->probability = profile_probability::uninitialized();
+  EDGE_SUCC(switch_block, 0)->flags = dispatch_flags;
+  EDGE_SUCC(switch_block, 0)->probability = profile_probability::never();
 
+  // Every case is equally likely until the counts are known, see below.
+  profile_probability case_probability = profile_probability::always().apply_scale(
+    1, std::max(case_label_vec.length(), 1u));
   for (auto& bbi : collected_blocks) {
-    make_edge(switch_block, BASIC_BLOCK_FOR_FN(f, bbi), 0);
+    if (!dispatched[bbi]) continue;
+
+    make_edge(switch_block, BASIC_BLOCK_FOR_FN(f, bbi), dispatch_flags)->probability =
+      case_probability;
+  }
+
+  // After the profile is estimated (ipa placement), the dispatch runs as often
+  // as the edges into it and each case as often as its block is reached
+  // through the switch, which the later passes decide hotness on.
+  if (profile_status_for_fn(f) != PROFILE_ABSENT) {
+    for (basic_block bb : joins) sum_incoming_counts(bb);
+    sum_incoming_counts(return_block);
+    sum_incoming_counts(switch_block);
+
+    edge e;
+    edge_iterator ei{};
+    FOR_EACH_EDGE(e, ei, switch_block->succs) {
+      if (e->dest == dummy_block) continue;
+
+      profile_count dispatches = e->dest->count;
+      edge pred;
+      edge_iterator pred_ei{};
+      FOR_EACH_EDGE(pred, pred_ei, e->dest->preds) {
+        if (pred != e) dispatches -= pred->count();
+      }
+      e->probability = dispatches.probability_in(switch_block->count);
+    }
   }
 
-  // We've moved the CFG around a lot, so throw away the computed dominators.
-  free_dominance_info(f, CDI_DOMINATORS);
+  if (dominators) {
+    joins.push_back(return_block);
+    joins.push_back(EXIT_BLOCK_PTR_FOR_FN(f));
+    update_dominators(f, collected_blocks, initialization_block, switch_block, joins);
+  }
   free_dominance_info(f, CDI_POST_DOMINATORS);
 
+  // The switch heads a new loop around every block which gets back to it, the
+  // loops flattening left intact nest inside it.
+  if (loops) {
+    loop_p dispatch = alloc_loop();
+    dispatch->header = switch_block;
+    dispatch->latch = return_block;
+    add_loop(dispatch, loops_for_fn(f)->tree_root);
+    restore_loop_properties(f);
+  } else if (current_loops) {
+    loops_state_set(LOOPS_NEED_FIXUP);
+  }
+
+  hellscape_done(f, "fla");
+
+  // Re-build SSA form for the demoted values and the switchVar.
+  if (in_ssa) {
+    return TODO_update_ssa;
+  }
+
   return 0;
 }
\ No newline at end of file
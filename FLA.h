@@ -25,23 +25,55 @@
 #include <memory>
 
 #include "Random.h"
+#include "Stats.h"
+#include "Profile.h"
+#include "Budget.h"
+#include "Instrument.h"
 
 const pass_data fla_pass_data = {
   GIMPLE_PASS,
   "fla",
 
   OPTGROUP_NONE,
-  TV_NONE,
+  TV_PLUGIN_RUN,
   PROP_gimple_any,
   0, 0, 0, 0
 };
 
 struct FLAPass : gimple_opt_pass {
+  /**
+   * How the switch finds the next block.
+   *
+   * DISPATCH_SWITCH: switchVar is a sparse random case value, which switch
+   * lowering turns into a tree of compares.
+   * DISPATCH_TABLE: switchVar is an encoded state, decoded to a dense index by
+   * the switch so it is lowered to a jump table.
+   * DISPATCH_THREADED: like DISPATCH_TABLE, but the index selects a label
+   * address for a computed goto, which GCC copies into every flattened block
+   * so each one gets an indirect jump (and branch predictor entry) of its own.
+   */
+  enum Dispatch {
+    DISPATCH_SWITCH,
+    DISPATCH_TABLE,
+    DISPATCH_THREADED,
+  };
+
   Random& mRandom;
+  Profile& mProfile;
+  Stats& mStats;
+  Budget& mBudget;
+  Instrument& mInstrument;
+  Dispatch mDispatch;
+  // Keep innermost loops intact instead of flattening the whole function.
+  bool mRegion;
   bool mEnable;
 
-  FLAPass(gcc::context* context, Random& random, bool enable = true) : gimple_opt_pass(
-    fla_pass_data, context), mRandom(random), mEnable(enable) {
+  FLAPass(gcc::context* context, Random& random, Profile& profile, Stats& stats, Budget& budget,
+          Instrument& instrument, Dispatch dispatch = DISPATCH_SWITCH, bool region = false,
+          bool enable = true)
+    : gimple_opt_pass(fla_pass_data, context), mRandom(random), mProfile(profile),
+      mStats(stats), mBudget(budget), mInstrument(instrument), mDispatch(dispatch),
+      mRegion(region), mEnable(enable) {
   }
 
   unsigned int execute(function* f) override;
@@ -0,0 +1,130 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Instrument.h"
+
+#include <basic-block.h>
+#include <tree-cfg.h>
+#include <stringpool.h>
+#include <gimple-expr.h>
+#include <ssa.h>
+#include <tree-into-ssa.h>
+#include <cgraph.h>
+
+#include <cstring>
+
+/**
+ * @return the declaration of uint64_t* __hellscape_profile_attach(uint32_t*,
+ *         const char*, const char*), the runtime's entry point
+ */
+static tree attach_decl() {
+  static tree decl = NULL_TREE;
+  if (decl != NULL_TREE) return decl;
+
+  tree string = build_pointer_type(build_qualified_type(char_type_node, TYPE_QUAL_CONST));
+  tree type = build_function_type_list(build_pointer_type(uint64_type_node),
+                                       build_pointer_type(unsigned_type_node), string, string,
+                                       NULL_TREE);
+  decl = build_fn_decl("__hellscape_profile_attach", type);
+  return decl;
+}
+
+/**
+ * @return a new static of the translation unit holding f's slot, 0 until the
+ *         runtime assigns one
+ */
+static tree create_slot() {
+  tree decl = build_decl(UNKNOWN_LOCATION, VAR_DECL, create_tmp_var_name("hellscape_slot"),
+                         unsigned_type_node);
+  TREE_STATIC(decl) = 1;
+  TREE_PUBLIC(decl) = 0;
+  TREE_USED(decl) = 1;
+  TREE_ADDRESSABLE(decl) = 1;
+  DECL_ARTIFICIAL(decl) = 1;
+  DECL_IGNORED_P(decl) = 1;
+  DECL_INITIAL(decl) = build_zero_cst(unsigned_type_node);
+
+  varpool_node::add(decl);
+  return decl;
+}
+
+/**
+ * @return the address of a string literal holding s
+ */
+static tree string_literal(const char* s) {
+  return build_string_literal(strlen(s) + 1, s);
+}
+
+tree Instrument::counters(function* f, bool fresh) {
+  bool in_ssa = gimple_in_ssa_p(f);
+
+  Attach& attach = mFunctions[f->decl];
+  if (attach.slot == NULL_TREE) attach.slot = create_slot();
+
+  // A register from before into-SSA is gone after it, and an SSA name may
+  // have been released by the passes in between.
+  tree counters = attach.counters;
+  bool valid = !fresh && counters != NULL_TREE && attach.ssa == in_ssa &&
+               (!in_ssa || (!SSA_NAME_IN_FREE_LIST(counters) &&
+                            gimple_bb(SSA_NAME_DEF_STMT(counters))));
+  if (valid) return counters;
+
+  // On entry, so it dominates every use.
+  basic_block bb = split_edge(single_succ_edge(ENTRY_BLOCK_PTR_FOR_FN(f)));
+  gimple_stmt_iterator gsi = gsi_last_bb(bb);
+
+  tree type = TREE_TYPE(TREE_TYPE(attach_decl()));
+  counters = in_ssa ? make_ssa_name(type) : create_tmp_reg(type, "counters");
+  gcall* call = gimple_build_call(attach_decl(), 3, build_fold_addr_expr(attach.slot),
+                                  string_literal(function_name(f)),
+                                  string_literal(main_input_filename ? main_input_filename : ""));
+  gimple_call_set_lhs(call, counters);
+  gsi_insert_after(&gsi, call, GSI_NEW_STMT);
+
+  // The call graph is only built after the early placement, later calls need
+  // their edge.
+  if (in_ssa) {
+    cgraph_node::get(f->decl)->create_edge(cgraph_node::get_create(attach_decl()), call,
+                                           bb->count);
+    mark_virtual_operands_for_renaming(f);
+  }
+
+  attach.counters = counters;
+  attach.ssa = in_ssa;
+  return counters;
+}
+
+gassign* Instrument::count(function* f, gimple_stmt_iterator* gsi, tree counters, Counter counter,
+                           uint64_t n) {
+  bool in_ssa = gimple_in_ssa_p(f);
+  tree type = uint64_type_node;
+
+  // counters[counter] += n
+  tree ref = build2(MEM_REF, type, counters,
+                    build_int_cst(build_pointer_type(type), counter * sizeof(uint64_t)));
+  tree value = in_ssa ? make_ssa_name(type) : create_tmp_reg(type, "count");
+  gsi_insert_before(gsi, gimple_build_assign(value, ref), GSI_SAME_STMT);
+
+  tree sum = in_ssa ? make_ssa_name(type) : create_tmp_reg(type, "count");
+  gassign* add = gimple_build_assign(sum, PLUS_EXPR, value, build_int_cst(type, n));
+  gsi_insert_before(gsi, add, GSI_SAME_STMT);
+  gsi_insert_before(gsi, gimple_build_assign(unshare_expr(ref), sum), GSI_SAME_STMT);
+
+  // The load and the store need virtual operands.
+  if (in_ssa) mark_virtual_operands_for_renaming(f);
+  return add;
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gcc-plugin.h>
+#include <tree.h>
+#include <function.h>
+#include <gimple.h>
+#include <gimple-iterator.h>
+
+#include <cstdint>
+#include <map>
+
+#include "runtime/hellscape_profile.h"
+
+/**
+ * Profiler mode (-fplugin-arg-hellscape-profile), counting at run time what
+ * the obfuscation executes, for staging builds linked with the
+ * hellscape-profile runtime.
+ *
+ * An instrumented function asks the runtime for its counters on entry, with
+ * __hellscape_profile_attach(&slot, "function", "tu.c"), which returns the
+ * calling thread's counters of the function. The passes then add to them
+ * where the obfuscation runs without any atomics: FLA once per dispatch, BCF
+ * once per opaque predicate and SUB the statements its rewrites added. FLA
+ * and BCF also add what the budget charged for each, priced for the target,
+ * to COST. The runtime sums the threads and writes the counters out at exit.
+ */
+class Instrument {
+public:
+  // Counters of a function, the runtime's.
+  enum Counter {
+    DISPATCHES = HELLSCAPE_PROFILE_DISPATCHES,
+    PREDICATES = HELLSCAPE_PROFILE_PREDICATES,
+    INSTRUCTIONS = HELLSCAPE_PROFILE_INSTRUCTIONS,
+    COST = HELLSCAPE_PROFILE_COST,
+  };
+
+  explicit Instrument(bool enable = false) : mEnable(enable) {
+  }
+
+  bool enabled() const {
+    return mEnable;
+  }
+
+  /**
+   * Attach f to its counters on entry, once for all passes as long as f stays
+   * in or out of SSA form.
+   *
+   * @param f function being instrumented
+   * @param fresh attach again, e.g.: when the block of the last attach is
+   *              about to be flattened
+   * @return pointer to the calling thread's counters of f
+   */
+  tree counters(function* f, bool fresh = false);
+
+  /**
+   * Add to a counter in front of a statement.
+   *
+   * @param f function being instrumented
+   * @param gsi statement to count in front of
+   * @param counters pointer returned by counters(f)
+   * @param counter counter to add to
+   * @param n amount to add
+   * @return the statement adding n
+   */
+  gassign* count(function* f, gimple_stmt_iterator* gsi, tree counters, Counter counter,
+                 uint64_t n = 1);
+
+  /**
+   * Add the time the budget charged for something to COST, in front of a
+   * statement.
+   *
+   * @param cost time, in the units of Budget::Cost
+   * @return the statement adding it
+   */
+  gassign* count_cost(function* f, gimple_stmt_iterator* gsi, tree counters, double cost) {
+    return count(f, gsi, counters, COST, (uint64_t) (cost * HELLSCAPE_PROFILE_COST_SCALE + 0.5));
+  }
+
+private:
+  struct Attach {
+    // Static index of the function in the runtime's tables.
+    tree slot;
+    tree counters;
+    bool ssa;
+  };
+
+  bool mEnable;
+  std::map<tree, Attach> mFunctions;
+};
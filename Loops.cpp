@@ -0,0 +1,85 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Loops.h"
+
+#include <tree.h>
+#include <dominance.h>
+#include <gimple-expr.h>
+#include <gimple.h>
+#include <ssa.h>
+
+bool update_loops(function* f) {
+  if (!current_loops) return false;
+
+  if (loops_state_satisfies_p(f, LOOPS_NEED_FIXUP)) {
+    calculate_dominance_info(CDI_DOMINATORS);
+    fix_loop_structure(NULL);
+    loops_state_clear(f, LOOPS_NEED_FIXUP);
+  }
+
+  return true;
+}
+
+void restore_loop_properties(function* f) {
+  bool exits = loops_state_satisfies_p(f, LOOPS_HAVE_RECORDED_EXITS);
+  if (exits) release_recorded_exits(f);
+
+  if (loops_state_satisfies_p(f, LOOPS_HAVE_PREHEADERS)) {
+    create_preheaders(loops_state_satisfies_p(f, LOOPS_HAVE_FALLTHRU_PREHEADERS)
+                      ? CP_FALLTHRU_PREHEADERS : CP_SIMPLE_PREHEADERS);
+  }
+  if (loops_state_satisfies_p(f, LOOPS_HAVE_SIMPLE_LATCHES)) force_single_succ_latches();
+  if (loops_state_satisfies_p(f, LOOPS_HAVE_MARKED_IRREDUCIBLE_REGIONS)) mark_irreducible_loops();
+
+  if (exits) record_loop_exits();
+}
+
+loop_p innermost_loop(basic_block bb) {
+  loop_p loop = bb->loop_father;
+  if (!loop || !loop_outer(loop) || loop->inner) return nullptr;
+
+  return loop;
+}
+
+bool is_loop_carried(gimple* stmt, loop_p loop) {
+  tree lhs = gimple_assign_lhs(stmt);
+
+  for (unsigned i = 1; i < gimple_num_ops(stmt); i++) {
+    tree op = gimple_op(stmt, i);
+
+    // Before SSA form: i = i + 1, sum = sum ^ _1.
+    if (op == lhs) return true;
+
+    // In SSA form: i_2 = i_1 + 1 with i_1 = PHI <i_0, i_2> in the header.
+    if (TREE_CODE(op) == SSA_NAME) {
+      gimple* def = SSA_NAME_DEF_STMT(op);
+      if (gimple_code(def) == GIMPLE_PHI && gimple_bb(def) == loop->header) return true;
+    }
+  }
+
+  if (TREE_CODE(lhs) == SSA_NAME) {
+    use_operand_p use_p;
+    imm_use_iterator iter;
+    FOR_EACH_IMM_USE_FAST(use_p, iter, lhs) {
+      gimple* use = USE_STMT(use_p);
+      if (gimple_code(use) == GIMPLE_PHI && gimple_bb(use) == loop->header) return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gcc-plugin.h>
+#include <function.h>
+#include <basic-block.h>
+#include <cfgloop.h>
+
+/**
+ * Bring the loop tree up to date if an earlier pass (e.g.: STR) changed the
+ * CFG and marked it for fixup.
+ *
+ * @param f function about to be transformed
+ * @return false if the function has no loop tree
+ */
+bool update_loops(function* f);
+
+/**
+ * Re-establish what the loop state promises (preheaders, simple latches,
+ * marked irreducible regions, recorded exits) after a pass changed the CFG but
+ * kept the loop tree itself up to date. This is the cheap part of what a
+ * fixup would do, without rediscovering every loop.
+ *
+ * @param f function whose loop tree is up to date
+ */
+void restore_loop_properties(function* f);
+
+/**
+ * @param bb block of a function with an up to date loop tree
+ * @return the loop bb belongs to if that loop has no inner loops, nullptr otherwise
+ */
+loop_p innermost_loop(basic_block bb);
+
+/**
+ * Check for the update of an induction variable or a reduction, i.e.: a
+ * statement on a cycle through the loop header. The vectorizer only recognizes
+ * those in their original shape.
+ *
+ * @param stmt statement in loop
+ * @param loop innermost loop
+ * @return true if stmt updates a value carried around loop
+ */
+bool is_loop_carried(gimple* stmt, loop_p loop);
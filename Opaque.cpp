@@ -0,0 +1,52 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Opaque.h"
+
+#include <stringpool.h>
+#include <cgraph.h>
+#include <varasm.h>
+
+#include <map>
+#include <string>
+
+// Declared once per compiler, two declarations of a symbol would clash.
+static std::map<std::string, tree> gGlobals;
+
+tree opaque_global(const char* name) {
+  auto it = gGlobals.find(name);
+  if (it != gGlobals.end()) return it->second;
+
+  tree decl = build_decl(UNKNOWN_LOCATION, VAR_DECL, get_identifier(name), integer_type_node);
+  // It's static we want to allocate storage for it.
+  TREE_STATIC(decl) = 1;
+  DECL_INITIAL(decl) = build_zero_cst(integer_type_node);
+  TREE_USED(decl) = 1;
+  TREE_PUBLIC(decl) = 1;
+  DECL_VISIBILITY(decl) = VISIBILITY_HIDDEN;
+  DECL_VISIBILITY_SPECIFIED(decl) = 1;
+  // Also keeps IPA from finding out nobody writes it and folding the loads.
+  varpool_node::get_create(decl)->force_output = 1;
+  // Merged with the copies of the other TUs, COMDAT or weak.
+  make_decl_one_only(decl, DECL_ASSEMBLER_NAME(decl));
+  // Unlike finalize_decl, add works at any point of the compilation, also
+  // after IPA in ipa placement and in LTRANS.
+  varpool_node::add(decl);
+
+  gGlobals.emplace(name, decl);
+  return decl;
+}
@@ -18,31 +18,16 @@
 #pragma once
 
 #include <gcc-plugin.h>
-
-#include <tree-pass.h>
-#include <context.h>
-#include <function.h>
-
-const pass_data viz_pass_data = {
-  GIMPLE_PASS,
-  "viz",
-
-  OPTGROUP_NONE,
-  TV_NONE,
-  PROP_gimple_any,
-  0, 0, 0, 0
-};
-
-struct VizPass : gimple_opt_pass {
-  bool mEnable;
-
-  explicit VizPass(gcc::context* context, bool enable = false) : gimple_opt_pass(
-    viz_pass_data, context), mEnable(enable) {
-  }
-
-  unsigned int execute(function* f) override;
-
-  VizPass* clone() override {
-    return this;
-  }
-};
+#include <tree.h>
+
+/**
+ * Declare one of the globals opaque expressions read, e.g.: BCF's predicates.
+ * Every TU (and every LTRANS partition) defines it weak and hidden, so the
+ * linker keeps a single copy per module, code reads it with a PC-relative load
+ * (no GOT entry, dynamic symbol or relocation) and nothing can prove it is
+ * still 0.
+ *
+ * @param name symbol name
+ * @return the declaration, the same one for every pass asking for name
+ */
+tree opaque_global(const char* name);
@@ -19,13 +19,24 @@
 #include <plugin-version.h>
 
 #include <tree-pass.h>
+#include <langhooks.h>
 
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include "Random.h"
-#include "Viz.h"
+#include "Profile.h"
+#include "Stats.h"
+#include "Budget.h"
+#include "Attributes.h"
+#include "Policy.h"
+#include "Dump.h"
+#include "Instrument.h"
 #include "SUB.h"
+#include "STR.h"
+#include "CON.h"
 #include "BCF.h"
 #include "FLA.h"
 
@@ -36,11 +47,53 @@ int plugin_is_GPL_compatible = 6 * 6 + 6;
 static struct plugin_info my_plugin_info = {"1.0.0",
                                             "The de-optimizing compiler."};
 
+// Seed without -fplugin-arg-hellscape-seed, "hell".
+static const uint32_t DEFAULT_SEED = 0x68656c6c;
+
 void finish_gcc(void* gcc_data, void* user_data) {
   // Delete the RNG.
   delete (Random*) user_data;
 }
 
+void finish_policy(void* gcc_data, void* user_data) {
+  set_policy(nullptr);
+  delete (Policy*) user_data;
+}
+
+void finish_profile(void* gcc_data, void* user_data) {
+  auto* profile = (Profile*) user_data;
+  profile->report(std::cerr);
+  delete profile;
+}
+
+void finish_stats(void* gcc_data, void* user_data) {
+  auto* stats = (Stats*) user_data;
+  std::string error;
+  if (!stats->flush(&error)) {
+    std::cerr << "error: stats: " << error << "\n";
+  }
+  delete stats;
+}
+
+void finish_budget(void* gcc_data, void* user_data) {
+  auto* budget = (Budget*) user_data;
+  budget->report(std::cerr);
+  delete budget;
+}
+
+void finish_instrument(void* gcc_data, void* user_data) {
+  delete (Instrument*) user_data;
+}
+
+void finish_dump(void* gcc_data, void* user_data) {
+  auto* dump = (Dump*) user_data;
+  std::string error;
+  if (!dump->close(&error)) {
+    std::cerr << "error: dump: " << error << "\n";
+  }
+  delete dump;
+}
+
 int plugin_init(struct plugin_name_args* plugin_info,
                 struct plugin_gcc_version* version) {
   if (!plugin_default_version_check(version, &gcc_version)) {
@@ -55,16 +108,57 @@ int plugin_init(struct plugin_name_args* plugin_info,
   // Default subLoop to 1.
   uint32_t subLoop = 1;
 
-  // Disable all passes by default.
-  bool enableFLA, enableBCF, enableSUB;
-  enableFLA = enableBCF = enableSUB = false;
+  // Substitute in loops the vectorizer may handle as well by default.
+  bool subVec = false;
 
-  // Seed the RNG if no seed is provided.
-  uint32_t seed;
-  if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) != sizeof(seed)) {
-    std::cerr << "error: getrandom initialization failed\n";
-    return 1;
-  }
+  // Let a statement grow into at most 16 by default.
+  uint32_t subMaxOps = 16;
+
+  // Choose among all rules by default.
+  int32_t subRule = -1;
+
+  // Obfuscate hot blocks too by default.
+  uint64_t hotThreshold = 0;
+
+  // Load the opaque predicate's globals in every guard by default.
+  bool bcfCache = false;
+
+  // Lower the flattening switch as a tree of compares by default.
+  FLAPass::Dispatch flaDispatch = FLAPass::DISPATCH_SWITCH;
+
+  // Flatten innermost loops too by default.
+  bool flaRegion = false;
+
+  // Obfuscate right after the CFG is built by default, before inlining.
+  bool placementIPA = false;
+
+  // No overhead or size limit and every candidate by default.
+  double maxOverhead = 0;
+  double maxGrowth = 0, maxTUGrowth = 0;
+  uint32_t perFLA = 100, perBCF = 100, perSUB = 100;
+
+  // No statistics by default.
+  std::string statsPath;
+
+  // No run time counters by default.
+  bool profileMode = false;
+
+  // No CFG dumps by default, into the working directory otherwise.
+  Dump::Format dumpFormat = Dump::FORMAT_NONE;
+  std::string dumpFilter;
+  std::string dumpDir = ".";
+
+  // No policy by default, freed in finish_policy.
+  Policy* policy = nullptr;
+
+  // Disable all passes by default, functions can still opt in with
+  // __attribute__((hellscape(...))).
+  bool enableFLA, enableBCF, enableSUB, enableSTR, enableCON;
+  enableFLA = enableBCF = enableSUB = enableSTR = enableCON = false;
+
+  // A fixed seed by default, so builds are reproducible on every host and
+  // every LTRANS partition of a link agrees on it.
+  uint32_t seed = DEFAULT_SEED;
 
   for (int i = 0; i < plugin_info->argc; i++) {
     std::string key = plugin_info->argv[i].key;
@@ -72,9 +166,15 @@ int plugin_init(struct plugin_name_args* plugin_info,
                         ? plugin_info->argv[i].value
                         : "";
 
-    // -fplugin-arg-hellscape-seed=deadbeef
+    // -fplugin-arg-hellscape-seed=deadbeef, or seed=random for a new seed
+    // every compilation
     if (key == "seed") {
-      if (value.size() == 8) {
+      if (value == "random") {
+        if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) != sizeof(seed)) {
+          std::cerr << "error: getrandom initialization failed\n";
+          return 1;
+        }
+      } else if (value.size() == 8) {
         char* none;
         seed = strtoul(value.c_str(), &none, 16);
 
@@ -96,23 +196,69 @@ seed_error:
     }
 
     // -fplugin-arg-hellscape-fla
-    // -fplugin-arg-hellscape-perFLA=30
     if (key == "fla") {
       enableFLA = true;
     }
 
     // -fplugin-arg-hellscape-bcf
-    // -fplugin-arg-hellscape-perBCF=30
     if (key == "bcf") {
       enableBCF = true;
     }
 
-    // -fplugin-arg-hellscape-sub
+    // -fplugin-arg-hellscape-perFLA=30
+    // -fplugin-arg-hellscape-perBCF=30
     // -fplugin-arg-hellscape-perSUB=30
+    if (key == "perFLA" || key == "perBCF" || key == "perSUB") {
+      char* none;
+      unsigned long percent = strtoul(value.c_str(), &none, 10);
+
+      if (value.empty() || *none != 0 || percent > 100) {
+        std::cerr << "error: " << key << " argument malformed\n";
+        return 1;
+      }
+
+      if (key == "perFLA") perFLA = percent;
+      if (key == "perBCF") perBCF = percent;
+      if (key == "perSUB") perSUB = percent;
+    }
+
+    // -fplugin-arg-hellscape-maxOverhead=15%
+    if (key == "maxOverhead") {
+      char* none;
+      maxOverhead = strtod(value.c_str(), &none);
+      if (*none == '%') none++;
+
+      if (value.empty() || *none != 0 || !(maxOverhead > 0)) {
+        std::cerr << "error: maxOverhead argument malformed\n";
+        return 1;
+      }
+    }
+
+    // -fplugin-arg-hellscape-bcfCache
+    if (key == "bcfCache") {
+      bcfCache = true;
+    }
+
+    // -fplugin-arg-hellscape-profile
+    if (key == "profile") {
+      profileMode = true;
+    }
+
+    // -fplugin-arg-hellscape-sub
     if (key == "sub") {
       enableSUB = true;
     }
 
+    // -fplugin-arg-hellscape-str
+    if (key == "str") {
+      enableSTR = true;
+    }
+
+    // -fplugin-arg-hellscape-con
+    if (key == "con") {
+      enableCON = true;
+    }
+
     // -fplugin-arg-hellscape-subLoop=3
     if (key == "subLoop") {
       char* none;
@@ -123,46 +269,267 @@ seed_error:
         return 1;
       }
     }
+
+    // -fplugin-arg-hellscape-flaDispatch=table
+    if (key == "flaDispatch") {
+      if (value == "switch") {
+        flaDispatch = FLAPass::DISPATCH_SWITCH;
+      } else if (value == "table") {
+        flaDispatch = FLAPass::DISPATCH_TABLE;
+      } else if (value == "threaded") {
+        flaDispatch = FLAPass::DISPATCH_THREADED;
+      } else {
+        std::cerr << "error: flaDispatch argument malformed\n";
+        return 1;
+      }
+    }
+
+    // -fplugin-arg-hellscape-flaRegion
+    if (key == "flaRegion") {
+      flaRegion = true;
+    }
+
+    // -fplugin-arg-hellscape-subVec
+    if (key == "subVec") {
+      subVec = true;
+    }
+
+    // -fplugin-arg-hellscape-subMaxOps=32
+    if (key == "subMaxOps") {
+      char* none;
+      subMaxOps = strtoul(value.c_str(), &none, 10);
+
+      if (value.empty() || *none != 0 || subMaxOps == 0) {
+        std::cerr << "error: subMaxOps argument malformed\n";
+        return 1;
+      }
+    }
+
+    // -fplugin-arg-hellscape-subRule=3
+    if (key == "subRule") {
+      char* none;
+      unsigned long rule = strtoul(value.c_str(), &none, 10);
+
+      if (value.empty() || *none != 0 || rule >= SUBPass::rule_count()) {
+        std::cerr << "error: subRule argument malformed\n";
+        return 1;
+      }
+      subRule = (int32_t) rule;
+    }
+
+    // -fplugin-arg-hellscape-placement=ipa
+    if (key == "placement") {
+      if (value == "early") {
+        placementIPA = false;
+      } else if (value == "ipa") {
+        placementIPA = true;
+      } else {
+        std::cerr << "error: placement argument malformed\n";
+        return 1;
+      }
+    }
+
+    // -fplugin-arg-hellscape-stats=stats.jsonl
+    if (key == "stats") {
+      if (value.empty()) {
+        std::cerr << "error: stats argument malformed\n";
+        return 1;
+      }
+
+      statsPath = value;
+    }
+
+    // -fplugin-arg-hellscape-dump=dot
+    if (key == "dump") {
+      if (value == "dot") {
+        dumpFormat = Dump::FORMAT_DOT;
+      } else if (value == "json") {
+        dumpFormat = Dump::FORMAT_JSON;
+      } else {
+        std::cerr << "error: dump argument malformed\n";
+        return 1;
+      }
+    }
+
+    // -fplugin-arg-hellscape-dumpFilter=crypto_*
+    if (key == "dumpFilter") {
+      dumpFilter = value;
+    }
+
+    // -fplugin-arg-hellscape-dumpDir=/tmp/dumps
+    if (key == "dumpDir") {
+      if (value.empty()) {
+        std::cerr << "error: dumpDir argument malformed\n";
+        return 1;
+      }
+
+      dumpDir = value;
+    }
+
+    // -fplugin-arg-hellscape-maxGrowth=2.5
+    // -fplugin-arg-hellscape-maxTUGrowth=2
+    if (key == "maxGrowth" || key == "maxTUGrowth") {
+      char* none;
+      double growth = strtod(value.c_str(), &none);
+
+      if (value.empty() || *none != 0 || !(growth >= 1)) {
+        std::cerr << "error: " << key << " argument malformed\n";
+        return 1;
+      }
+
+      if (key == "maxGrowth") maxGrowth = growth;
+      if (key == "maxTUGrowth") maxTUGrowth = growth;
+    }
+
+    // -fplugin-arg-hellscape-policy=policy.hsp
+    if (key == "policy") {
+      std::string error;
+      delete policy;
+      policy = Policy::open(value.c_str(), &error);
+
+      if (!policy) {
+        std::cerr << "error: policy: " << error << "\n";
+        return 1;
+      }
+    }
+
+    // -fplugin-arg-hellscape-hot=100000
+    if (key == "hot") {
+      char* none;
+      hotThreshold = strtoull(value.c_str(), &none, 10);
+
+      if (value.empty() || *none != 0 || hotThreshold == 0) {
+        std::cerr << "error: hot argument malformed\n";
+        return 1;
+      }
+    }
+  }
+
+  // lto1 reads the functions with their CFG already built, so cfg never runs
+  // there: with -flto the passes run after IPA in every LTRANS partition, once
+  // whole-program inlining and cloning are done.
+  if (strcmp(lang_hooks.name, "GNU GIMPLE") == 0) {
+    placementIPA = true;
   }
 
   // Allocate RNG, freed in finish_gcc
   auto* random = new Random (seed);
 
+  // Allocate the profile, freed in finish_profile
+  auto* profile = new Profile(hotThreshold);
+
+  // Allocate the statistics, written and freed in finish_stats
+  auto* stats = new Stats();
+  if (!statsPath.empty()) {
+    std::string error;
+    if (!stats->open(statsPath.c_str(), &error)) {
+      std::cerr << "error: stats: " << error << "\n";
+      return 1;
+    }
+  }
+
+  // Allocate the budget, reported and freed in finish_budget
+  auto* budget = new Budget(maxOverhead / 100, maxGrowth, maxTUGrowth, perFLA, perBCF, perSUB);
+
+  // Allocate the run time counters, freed in finish_instrument
+  auto* instrument = new Instrument(profileMode);
+
+  // Allocate the dumps, closed and freed in finish_dump
+  auto* dump = new Dump();
+  dump->configure(dumpFormat, dumpFilter, dumpDir);
+
+  // In ipa placement all passes run on SSA form right after IPA (ehdisp is the
+  // first pass of the per-function pipeline after it), once inlining and the
+  // early optimizations are done.
   struct register_pass_info sub_pass_info{};
-  sub_pass_info.pass = new SUBPass(g, *random, subLoop, enableSUB);
-  sub_pass_info.reference_pass_name = "cfg";
+  sub_pass_info.pass = new SUBPass(g, *random, *stats, *budget, *instrument, subLoop, subMaxOps,
+                                   subVec, subRule, enableSUB);
+  sub_pass_info.reference_pass_name = placementIPA ? "ehdisp" : "cfg";
   sub_pass_info.ref_pass_instance_number = 1;
   sub_pass_info.pos_op = PASS_POS_INSERT_AFTER;
 
+  struct register_pass_info str_pass_info{};
+  str_pass_info.pass = new STRPass(g, *random, *stats, *budget, enableSTR);
+  str_pass_info.reference_pass_name = "sub";
+  str_pass_info.ref_pass_instance_number = 1;
+  str_pass_info.pos_op = PASS_POS_INSERT_AFTER;
+
+  struct register_pass_info con_pass_info{};
+  con_pass_info.pass = new CONPass(g, *random, *stats, *budget, enableCON);
+  con_pass_info.reference_pass_name = "str";
+  con_pass_info.ref_pass_instance_number = 1;
+  con_pass_info.pos_op = PASS_POS_INSERT_AFTER;
+
   struct register_pass_info bcf_pass_info{};
-  bcf_pass_info.pass = new BCFPass(g, *random, enableBCF);
-  bcf_pass_info.reference_pass_name = "sub";
+  bcf_pass_info.pass = new BCFPass(g, *random, *profile, *stats, *budget, *instrument, bcfCache,
+                                   enableBCF);
+  // Profile counts are only read during IPA, so in hot mode the CFG passes run
+  // after it even in early placement.
+  bcf_pass_info.reference_pass_name = profile->enabled() && !placementIPA ? "ehdisp" : "con";
   bcf_pass_info.ref_pass_instance_number = 1;
   bcf_pass_info.pos_op = PASS_POS_INSERT_AFTER;
 
   struct register_pass_info fla_pass_info{};
-  fla_pass_info.pass = new FLAPass(g, *random, enableFLA);
+  fla_pass_info.pass = new FLAPass(g, *random, *profile, *stats, *budget, *instrument, flaDispatch,
+                                   flaRegion, enableFLA);
   fla_pass_info.reference_pass_name = "bcf";
   fla_pass_info.ref_pass_instance_number = 1;
   fla_pass_info.pos_op = PASS_POS_INSERT_AFTER;
 
-  // Viz is disabled by default and cannot be enabled via CLI, so this is a no-op.
-  struct register_pass_info viz_pass_info{};
-  viz_pass_info.pass = new VizPass(g /*, true */);
-  viz_pass_info.reference_pass_name = "fla";
-  viz_pass_info.ref_pass_instance_number = 1;
-  viz_pass_info.pos_op = PASS_POS_INSERT_AFTER;
+  // Dump the input of the passes and the output of each one. In hot mode with
+  // early placement, BCF's input is the IPA output rather than SUB's.
+  std::vector<register_pass_info> dump_pass_infos;
+  auto add_dump = [&](const char* stage, const char* reference, pass_positioning_ops pos) {
+    struct register_pass_info info{};
+    info.pass = new DumpPass(g, *dump, stage);
+    info.reference_pass_name = reference;
+    info.ref_pass_instance_number = 1;
+    info.pos_op = pos;
+    dump_pass_infos.push_back(info);
+  };
+
+  if (dump->enabled()) {
+    add_dump("input", "sub", PASS_POS_INSERT_BEFORE);
+    add_dump("sub", "sub", PASS_POS_INSERT_AFTER);
+    add_dump("str", "str", PASS_POS_INSERT_AFTER);
+    add_dump("con", "con", PASS_POS_INSERT_AFTER);
+    if (profile->enabled() && !placementIPA) {
+      add_dump("ipa", "bcf", PASS_POS_INSERT_BEFORE);
+    }
+    add_dump("bcf", "bcf", PASS_POS_INSERT_AFTER);
+    add_dump("fla", "fla", PASS_POS_INSERT_AFTER);
+  }
+
+  register_callback(plugin_info->base_name, PLUGIN_ATTRIBUTES,
+                    register_attributes, nullptr);
+
+  if (policy) {
+    set_policy(policy);
+    register_callback(plugin_info->base_name, PLUGIN_FINISH, finish_policy, policy);
+  }
 
   register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, nullptr,
                     &sub_pass_info);
+  register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, nullptr,
+                    &str_pass_info);
+  register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, nullptr,
+                    &con_pass_info);
   register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, nullptr,
                     &bcf_pass_info);
   register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, nullptr,
                     &fla_pass_info);
-  register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, nullptr,
-                    &viz_pass_info);
+  // After the obfuscation passes, which the dumps are placed around.
+  for (auto& info : dump_pass_infos) {
+    register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, nullptr,
+                      &info);
+  }
 
   register_callback(plugin_info->base_name, PLUGIN_FINISH, finish_gcc, random);
+  register_callback(plugin_info->base_name, PLUGIN_FINISH, finish_profile, profile);
+  register_callback(plugin_info->base_name, PLUGIN_FINISH, finish_stats, stats);
+  register_callback(plugin_info->base_name, PLUGIN_FINISH, finish_dump, dump);
+  register_callback(plugin_info->base_name, PLUGIN_FINISH, finish_instrument, instrument);
+  register_callback(plugin_info->base_name, PLUGIN_FINISH, finish_budget, budget);
 
   return 0;
 }
@@ -0,0 +1,107 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Policy.h"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Policy* Policy::open(const char* path, std::string* error) {
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    *error = std::string("cannot open ") + path + ": " + strerror(errno);
+    return nullptr;
+  }
+
+  struct stat st{};
+  if (fstat(fd, &st) != 0) {
+    *error = std::string("cannot stat ") + path + ": " + strerror(errno);
+    ::close(fd);
+    return nullptr;
+  }
+
+  auto size = (size_t) st.st_size;
+  if (size < sizeof(Header)) {
+    *error = std::string(path) + " is not a compiled policy, run hellscape-policy on it";
+    ::close(fd);
+    return nullptr;
+  }
+
+  void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    *error = std::string("cannot map ") + path + ": " + strerror(errno);
+    return nullptr;
+  }
+
+  auto* header = (const Header*) map;
+  if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0) {
+    *error = std::string(path) + " is not a compiled policy, run hellscape-policy on it";
+    munmap(map, size);
+    return nullptr;
+  }
+
+  // Only the sizes are checked here, lookup bounds-checks every step instead
+  // of validating the whole table up front in every compiler invocation.
+  uint64_t expected = sizeof(Header) +
+                      (uint64_t) header->states * header->classes * sizeof(uint32_t) +
+                      (uint64_t) header->states * sizeof(int32_t) +
+                      (uint64_t) header->rules * sizeof(Rule);
+  if (header->version != VERSION || header->states == 0 ||
+      header->classes == 0 || header->classes > 256 || expected != size) {
+    *error = std::string(path) + " was compiled by another version of hellscape-policy";
+    munmap(map, size);
+    return nullptr;
+  }
+
+  auto* policy = new Policy();
+  policy->mMap = map;
+  policy->mSize = size;
+  policy->mHeader = header;
+  policy->mTransitions = (const uint32_t*) (header + 1);
+  policy->mAccept = (const int32_t*) (policy->mTransitions +
+                                      (size_t) header->states * header->classes);
+  policy->mRules = (const Rule*) (policy->mAccept + header->states);
+  return policy;
+}
+
+Policy::~Policy() {
+  munmap(mMap, mSize);
+}
+
+const Policy::Rule* Policy::lookup(const char* name) const {
+  uint32_t states = mHeader->states;
+  uint32_t classes = mHeader->classes;
+
+  uint32_t state = 0;
+  for (const char* c = name; *c; c++) {
+    uint8_t cls = mHeader->byteClass[(uint8_t) *c];
+    if (cls >= classes) return nullptr;
+
+    state = mTransitions[(size_t) state * classes + cls];
+    if (state >= states) return nullptr;
+  }
+
+  int32_t rule = mAccept[state];
+  if (rule < 0 || (uint32_t) rule >= mHeader->rules) return nullptr;
+
+  return &mRules[rule];
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * Compiled obfuscation policy, mapping function names to passes.
+ *
+ * The textual policy is compiled once by hellscape-policy into a DFA over all
+ * patterns, the plugin only maps the file and walks the DFA, so matching a
+ * name costs one table lookup per character no matter how many rules there
+ * are. Shared by the plugin and the compiler, so it must not depend on GCC.
+ *
+ * The file is the header, followed by the transitions (states * classes
+ * uint32_t, DEAD if there is none), the accepting rule of each state (states
+ * int32_t, -1 if none) and the rules. It is only meant to be read on the host
+ * that wrote it.
+ */
+class Policy {
+public:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t states;
+    uint32_t classes;
+    uint32_t rules;
+    // Bytes which no pattern tells apart share a class.
+    uint8_t byteClass[256];
+  };
+
+  struct Rule {
+    uint32_t flags;
+    uint32_t passes;
+    uint32_t subLoop;
+  };
+
+  static constexpr char MAGIC[8] = {'H', 'S', 'P', 'O', 'L', 'I', 'C', 'Y'};
+  static constexpr uint32_t VERSION = 1;
+  static constexpr uint32_t DEAD = 0xffffffff;
+
+  // Rule::passes
+  static constexpr uint32_t FLA = 1 << 0;
+  static constexpr uint32_t BCF = 1 << 1;
+  static constexpr uint32_t SUB = 1 << 2;
+  static constexpr uint32_t STR = 1 << 3;
+  static constexpr uint32_t CON = 1 << 4;
+
+  // Rule::flags, which fields the rule sets.
+  static constexpr uint32_t HAS_PASSES = 1 << 0;
+  static constexpr uint32_t HAS_SUB_LOOP = 1 << 1;
+
+  /**
+   * @return the Rule::passes bit for a pass name, 0 if unknown
+   */
+  static uint32_t pass_bit(const char* pass) {
+    if (strcmp(pass, "fla") == 0) return FLA;
+    if (strcmp(pass, "bcf") == 0) return BCF;
+    if (strcmp(pass, "sub") == 0) return SUB;
+    if (strcmp(pass, "str") == 0) return STR;
+    if (strcmp(pass, "con") == 0) return CON;
+    return 0;
+  }
+
+  /**
+   * Map a compiled policy.
+   *
+   * @param path file written by hellscape-policy
+   * @param error set to the reason on failure
+   * @return the policy, or nullptr on failure
+   */
+  static Policy* open(const char* path, std::string* error);
+
+  ~Policy();
+
+  Policy(const Policy&) = delete;
+  Policy& operator=(const Policy&) = delete;
+
+  /**
+   * @param name function name
+   * @return the first rule whose pattern matches the whole name, or nullptr
+   */
+  const Rule* lookup(const char* name) const;
+
+private:
+  Policy() = default;
+
+  void* mMap = nullptr;
+  size_t mSize = 0;
+
+  const Header* mHeader = nullptr;
+  const uint32_t* mTransitions = nullptr;
+  const int32_t* mAccept = nullptr;
+  const Rule* mRules = nullptr;
+};
@@ -0,0 +1,82 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Profile.h"
+
+#include <basic-block.h>
+#include <profile-count.h>
+#include <cfg.h>
+#include <predict.h>
+#include <tree.h>
+#include <gimple.h>
+#include <gimple-iterator.h>
+
+#include <iomanip>
+
+/**
+ * @return the number of times the block executed according to the profile, or
+ * 0 if there is no profile for it
+ */
+static uint64_t block_count(basic_block bb) {
+  // Only counts read from a profile are comparable across functions, guesses
+  // made by the static predictor come back uninitialized.
+  profile_count count = bb->count.ipa();
+  if (!count.initialized_p()) return 0;
+
+  return count.to_gcov_type();
+}
+
+bool Profile::is_hot(basic_block bb) const {
+  if (!enabled()) return false;
+
+  return block_count(bb) >= mThreshold;
+}
+
+void Profile::account(const char* pass, basic_block bb, bool obfuscated) {
+  if (!enabled()) return;
+
+  uint64_t count = block_count(bb);
+  Coverage& coverage = mCoverage[pass];
+  coverage.total += count;
+  if (obfuscated) coverage.obfuscated += count;
+}
+
+void Profile::report(std::ostream& out) const {
+  for (auto& e : mCoverage) {
+    const Coverage& coverage = e.second;
+    // Nothing was profiled, e.g.: compiled without -fprofile-use.
+    if (coverage.total == 0) continue;
+
+    out << "note: hellscape: " << e.first << " obfuscated " << std::fixed
+        << std::setprecision(1)
+        << 100.0 * coverage.obfuscated / coverage.total
+        << "% of profiled execution (" << coverage.obfuscated << " of "
+        << coverage.total << " block executions)\n";
+  }
+}
+
+void Profile::mark_cold(function* f, basic_block bb) {
+  // Before the profile is estimated the predictors decide, a cold label hint
+  // has the estimate treat the block as never executed. Afterwards (ipa
+  // placement) the count and the edge probabilities set by the pass stay.
+  if (profile_status_for_fn(f) == PROFILE_ABSENT) {
+    gimple_stmt_iterator gsi = gsi_after_labels(bb);
+    gsi_insert_before(&gsi, gimple_build_predict(PRED_COLD_LABEL, NOT_TAKEN), GSI_SAME_STMT);
+  }
+
+  bb->count = profile_count::zero();
+}
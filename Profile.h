@@ -0,0 +1,82 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gcc-plugin.h>
+#include <basic-block.h>
+#include <function.h>
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+
+/**
+ * Block hotness as measured by -fprofile-use or AutoFDO.
+ *
+ * The counts are attached to the CFG by the IPA profile pass, so they are only
+ * visible to passes that run after IPA. Blocks without a count are cold.
+ */
+class Profile {
+private:
+  struct Coverage {
+    uint64_t total = 0;
+    uint64_t obfuscated = 0;
+  };
+
+  // Blocks executed at least this many times are hot, 0 disables the mode.
+  uint64_t mThreshold;
+  std::map<std::string, Coverage> mCoverage;
+
+public:
+  explicit Profile(uint64_t threshold = 0) : mThreshold(threshold) {
+  }
+
+  bool enabled() const {
+    return mThreshold != 0;
+  }
+
+  /**
+   * @return true if the block should be left alone by the heavy passes
+   */
+  bool is_hot(basic_block bb) const;
+
+  /**
+   * Record the dynamic execution of a block for the coverage report.
+   *
+   * @param pass name of the pass making the decision
+   * @param bb block considered by the pass
+   * @param obfuscated whether the pass transformed it
+   */
+  void account(const char* pass, basic_block bb, bool obfuscated);
+
+  /**
+   * Print the fraction of profiled execution each pass obfuscated.
+   */
+  void report(std::ostream& out) const;
+
+  /**
+   * Mark a block added by a pass as never executed (junk and default blocks),
+   * so block reordering keeps it off the fall-through path and
+   * -freorder-blocks-and-partition moves it to .text.unlikely.
+   *
+   * @param f function the block belongs to
+   * @param bb block which never executes
+   */
+  static void mark_cold(function* f, basic_block bb);
+};
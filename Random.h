@@ -18,17 +18,73 @@
 #pragma once
 
 #include <cstdint>
-#include <random>
 
+/**
+ * Random decisions of the passes, derived from the seed and what is being
+ * transformed instead of drawn from one generator in compilation order.
+ *
+ * A stream is keyed on (seed, symbol, pass, index), so a function is
+ * obfuscated the same way no matter which functions were compiled before it,
+ * in which translation unit, at which -j or on which host: adding a function
+ * only changes its own code and incremental or cached builds stay
+ * reproducible.
+ */
 class Random {
-private:
-  std::mt19937 mRandom;
-
 public:
-  explicit Random(int32_t seed) : mRandom(seed) {
+  /**
+   * splitmix64 over a keyed state, cheap to create per function or block.
+   */
+  class Stream {
+  public:
+    explicit Stream(uint64_t state) : mState(state) {
+    }
+
+    int32_t nextInt() {
+      return (int32_t) (next() >> 32);
+    }
+
+  private:
+    uint64_t next() {
+      mState += 0x9e3779b97f4a7c15;
+      return mix(mState);
+    }
+
+    uint64_t mState;
+  };
+
+  explicit Random(uint32_t seed) : mSeed(seed) {
   }
 
-  int32_t nextInt() {
-    return mRandom();
+  /**
+   * @param symbol assembler name of the function
+   * @param pass name of the pass, e.g.: "fla"
+   * @param index part of the function the decisions are for, e.g.: a hash of a
+   *              block's statements
+   * @return the stream for the key
+   */
+  Stream stream(const char* symbol, const char* pass, uint32_t index = 0) const {
+    uint64_t state = mix(mSeed ^ hash(symbol));
+    state = mix(state ^ hash(pass));
+    return Stream(mix(state ^ index));
   }
-};
\ No newline at end of file
+
+private:
+  // splitmix64's finalizer.
+  static uint64_t mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+  }
+
+  // FNV-1a.
+  static uint64_t hash(const char* s) {
+    uint64_t h = 0xcbf29ce484222325;
+    for (const char* c = s; *c; c++) {
+      h = (h ^ (uint8_t) *c) * 0x100000001b3;
+    }
+
+    return h;
+  }
+
+  uint64_t mSeed;
+};
@@ -0,0 +1,443 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "STR.h"
+#include "Attributes.h"
+
+#include <basic-block.h>
+#include <tree.h>
+#include <tree-cfg.h>
+#include <stringpool.h>
+#include <memmodel.h>
+#include <builtins.h>
+
+#include <gimple.h>
+#include <gimple-iterator.h>
+#include <ssa.h>
+#include <tree-into-ssa.h>
+#include <tree-phinodes.h>
+
+#include <cgraph.h>
+#include <cfgloop.h>
+
+#include <algorithm>
+#include <vector>
+
+// Guard states.
+static const int ENCRYPTED = 0;
+static const int DECRYPTING = 1;
+static const int DECRYPTED = 2;
+
+/**
+ * Declare a static variable of the translation unit.
+ *
+ * @param type type of the variable
+ * @param prefix start of its (local) symbol name
+ * @param init initializer, NULL_TREE for zero
+ * @return the declaration
+ */
+static tree create_static(tree type, const char* prefix, tree init) {
+  tree decl = build_decl(UNKNOWN_LOCATION, VAR_DECL, create_tmp_var_name(prefix), type);
+  TREE_STATIC(decl) = 1;
+  TREE_PUBLIC(decl) = 0;
+  TREE_USED(decl) = 1;
+  DECL_ARTIFICIAL(decl) = 1;
+  DECL_IGNORED_P(decl) = 1;
+  DECL_INITIAL(decl) = init;
+  if (init) TREE_READONLY(decl) = 1;
+
+  varpool_node::add(decl);
+  return decl;
+}
+
+/**
+ * @return the literal op refers to, e.g.: "abc" in &"abc"[0], or NULL_TREE
+ */
+static tree string_operand(tree op) {
+  if (!op || TREE_CODE(op) != ADDR_EXPR) return NULL_TREE;
+
+  tree base = TREE_OPERAND(op, 0);
+  if (TREE_CODE(base) == ARRAY_REF && integer_zerop(TREE_OPERAND(base, 1))) {
+    base = TREE_OPERAND(base, 0);
+  }
+
+  return TREE_CODE(base) == STRING_CST ? base : NULL_TREE;
+}
+
+/**
+ * @return the byte i of the key stream of a literal
+ */
+static uint8_t key_byte(const STRPass::Literal& literal, uint32_t i) {
+  return (uint8_t) ((i * literal.multiplier + literal.offset) >> 24);
+}
+
+const STRPass::Literal* STRPass::literal(tree string) {
+  HOST_WIDE_INT size = int_size_in_bytes(TREE_TYPE(string));
+  if (size <= 0 || size > INT32_MAX) return nullptr;
+
+  // The literal may be shorter than its array type, the rest is zeros.
+  std::string bytes(TREE_STRING_POINTER(string),
+                    std::min<HOST_WIDE_INT>(TREE_STRING_LENGTH(string), size));
+  bytes.resize(size, 0);
+
+  tree element = TREE_TYPE(TREE_TYPE(string));
+  std::string key = bytes;
+  key.push_back((char) int_size_in_bytes(element));
+
+  auto it = mLiterals.find(key);
+  if (it != mLiterals.end()) return &it->second;
+
+  // Keyed on the contents, so a literal is encrypted the same way in every
+  // translation unit.
+  uint32_t hash = 2166136261u;
+  for (char c : key) hash = (hash ^ (uint8_t) c) * 16777619u;
+  Random::Stream random = mRandom.stream("", "str", hash);
+
+  Literal literal{};
+  literal.size = size;
+  literal.multiplier = (uint32_t) random.nextInt() | 1;
+  literal.offset = (uint32_t) random.nextInt();
+
+  for (uint32_t i = 0; i < literal.size; i++) {
+    bytes[i] ^= key_byte(literal, i);
+  }
+
+  tree bytes_type = build_array_type_nelts(unsigned_char_type_node, literal.size);
+  tree init = build_string(literal.size, bytes.data());
+  TREE_TYPE(init) = bytes_type;
+  TREE_CONSTANT(init) = 1;
+  TREE_STATIC(init) = 1;
+
+  literal.encrypted = create_static(bytes_type, "str", init);
+
+  literal.buffer = create_static(bytes_type, "strbuf", NULL_TREE);
+  TREE_ADDRESSABLE(literal.buffer) = 1;
+  SET_DECL_ALIGN(literal.buffer, std::max(DECL_ALIGN(literal.buffer), TYPE_ALIGN(element)));
+  DECL_USER_ALIGN(literal.buffer) = 1;
+
+  literal.guard = create_static(unsigned_type_node, "strguard", NULL_TREE);
+  TREE_ADDRESSABLE(literal.guard) = 1;
+
+  return &mLiterals.emplace(key, literal).first->second;
+}
+
+/**
+ * @return a new register of the given type
+ */
+static tree make_reg(tree type, bool in_ssa) {
+  return in_ssa ? make_ssa_name(type) : create_tmp_reg(type, "str");
+}
+
+/**
+ * @return a new block after after, in its loop
+ */
+static basic_block create_block(basic_block after) {
+  basic_block bb = create_empty_bb(after);
+  if (current_loops) add_bb_to_loop(bb, after->loop_father);
+  return bb;
+}
+
+/**
+ * End bb with if (lhs == rhs), the true edge going to then_bb.
+ */
+static void end_with_cond(basic_block bb, tree lhs, tree rhs, basic_block then_bb,
+                          basic_block else_bb, profile_probability then_probability) {
+  gimple_stmt_iterator gsi = gsi_last_bb(bb);
+  gsi_insert_after(&gsi, gimple_build_cond(EQ_EXPR, lhs, rhs, NULL_TREE, NULL_TREE),
+                   GSI_NEW_STMT);
+
+  make_edge(bb, then_bb, EDGE_TRUE_VALUE)->probability = then_probability;
+  make_edge(bb, else_bb, EDGE_FALSE_VALUE)->probability = then_probability.invert();
+}
+
+/**
+ * Make sure the buffer of a literal is decrypted before the statement at gsi,
+ * which moves to a block of its own:
+ *
+ *   check:   if (__atomic_load(&guard, acquire) == DECRYPTED) goto use;
+ *   claim:   if (__sync_val_compare_and_swap(&guard, ENCRYPTED, DECRYPTING) != ENCRYPTED) goto wait;
+ *   decrypt: for (i = 0; i < size; i++) buffer[i] = encrypted[i] ^ key(i);
+ *            __atomic_store(&guard, DECRYPTED, release); goto use;
+ *   wait:    while (__atomic_load(&guard, acquire) != DECRYPTED);
+ *   use:     ...
+ */
+static void insert_decrypt(gimple_stmt_iterator* gsi, const STRPass::Literal& literal,
+                           bool in_ssa) {
+  tree load = builtin_decl_explicit(BUILT_IN_ATOMIC_LOAD_4);
+  tree store = builtin_decl_explicit(BUILT_IN_ATOMIC_STORE_4);
+  tree cas = builtin_decl_explicit(BUILT_IN_SYNC_VAL_COMPARE_AND_SWAP_4);
+  tree state_type = TREE_TYPE(TREE_TYPE(load));
+  tree guard = build_fold_addr_expr(literal.guard);
+  tree acquire = build_int_cst(integer_type_node, MEMMODEL_ACQUIRE);
+  tree release = build_int_cst(integer_type_node, MEMMODEL_RELEASE);
+
+  // Split in front of the statement, the check goes in between.
+  basic_block bb = gsi_bb(*gsi);
+  gimple_stmt_iterator prev = *gsi;
+  gsi_prev(&prev);
+  edge e = gsi_end_p(prev) ? split_block_after_labels(bb) : split_block(bb, gsi_stmt(prev));
+  basic_block use = e->dest;
+  basic_block check = split_edge(e);
+
+  basic_block claim = create_block(check);
+  basic_block init = create_block(claim);
+  basic_block loop = create_block(init);
+  basic_block publish = create_block(loop);
+  basic_block wait = create_block(publish);
+
+  // Only the first use ever leaves the fast path.
+  remove_edge(single_succ_edge(check));
+  tree state = make_reg(state_type, in_ssa);
+  gimple* call = gimple_build_call(load, 2, guard, acquire);
+  gimple_call_set_lhs(call, state);
+  gimple_stmt_iterator check_gsi = gsi_last_bb(check);
+  gsi_insert_after(&check_gsi, call, GSI_NEW_STMT);
+  end_with_cond(check, state, build_int_cst(state_type, DECRYPTED), use, claim,
+                profile_probability::very_likely());
+
+  tree old = make_reg(state_type, in_ssa);
+  call = gimple_build_call(cas, 3, guard, build_int_cst(state_type, ENCRYPTED),
+                           build_int_cst(state_type, DECRYPTING));
+  gimple_call_set_lhs(call, old);
+  gimple_stmt_iterator claim_gsi = gsi_last_bb(claim);
+  gsi_insert_after(&claim_gsi, call, GSI_NEW_STMT);
+  end_with_cond(claim, old, build_int_cst(state_type, ENCRYPTED), init, wait,
+                profile_probability::likely());
+
+  // The index is carried around the loop, in SSA form by a PHI.
+  tree i = make_reg(unsigned_type_node, in_ssa);
+  tree next = in_ssa ? make_ssa_name(unsigned_type_node) : i;
+  edge enter = make_single_succ_edge(init, loop, EDGE_FALLTHRU);
+  if (!in_ssa) {
+    gimple_stmt_iterator init_gsi = gsi_last_bb(init);
+    gsi_insert_after(&init_gsi, gimple_build_assign(i, build_zero_cst(unsigned_type_node)),
+                     GSI_NEW_STMT);
+  }
+
+  // buffer[i] = encrypted[i] ^ (i * multiplier + offset) >> 24
+  gimple_stmt_iterator loop_gsi = gsi_last_bb(loop);
+  auto emit = [&](tree lhs, tree_code code, tree rhs1, tree rhs2) {
+    gsi_insert_after(&loop_gsi, gimple_build_assign(lhs, code, rhs1, rhs2), GSI_NEW_STMT);
+    return lhs;
+  };
+
+  tree byte = make_reg(unsigned_char_type_node, in_ssa);
+  gsi_insert_after(&loop_gsi, gimple_build_assign(byte, build4(ARRAY_REF, unsigned_char_type_node,
+                                                               literal.encrypted, i, NULL_TREE,
+                                                               NULL_TREE)),
+                   GSI_NEW_STMT);
+  tree key = emit(make_reg(unsigned_type_node, in_ssa), MULT_EXPR, i,
+                  build_int_cst(unsigned_type_node, literal.multiplier));
+  key = emit(make_reg(unsigned_type_node, in_ssa), PLUS_EXPR, key,
+             build_int_cst(unsigned_type_node, literal.offset));
+  key = emit(make_reg(unsigned_type_node, in_ssa), RSHIFT_EXPR, key,
+             build_int_cst(unsigned_type_node, 24));
+  tree mask = make_reg(unsigned_char_type_node, in_ssa);
+  gsi_insert_after(&loop_gsi, gimple_build_assign(mask, NOP_EXPR, key), GSI_NEW_STMT);
+  tree plain = emit(make_reg(unsigned_char_type_node, in_ssa), BIT_XOR_EXPR, byte, mask);
+  gsi_insert_after(&loop_gsi, gimple_build_assign(build4(ARRAY_REF, unsigned_char_type_node,
+                                                         literal.buffer, i, NULL_TREE,
+                                                         NULL_TREE), plain),
+                   GSI_NEW_STMT);
+  emit(next, PLUS_EXPR, i, build_one_cst(unsigned_type_node));
+  gsi_insert_after(&loop_gsi, gimple_build_cond(LT_EXPR, next,
+                                                build_int_cst(unsigned_type_node, literal.size),
+                                                NULL_TREE, NULL_TREE),
+                   GSI_NEW_STMT);
+  profile_probability again = profile_probability::always().apply_scale(
+    literal.size - 1, literal.size);
+  edge back = make_edge(loop, loop, EDGE_TRUE_VALUE);
+  back->probability = again;
+  make_edge(loop, publish, EDGE_FALSE_VALUE)->probability = again.invert();
+
+  if (in_ssa) {
+    gphi* phi = create_phi_node(i, loop);
+    add_phi_arg(phi, build_zero_cst(unsigned_type_node), enter, UNKNOWN_LOCATION);
+    add_phi_arg(phi, next, back, UNKNOWN_LOCATION);
+  }
+
+  gimple_stmt_iterator publish_gsi = gsi_last_bb(publish);
+  gsi_insert_after(&publish_gsi, gimple_build_call(store, 3, guard,
+                                                   build_int_cst(state_type, DECRYPTED),
+                                                   release),
+                   GSI_NEW_STMT);
+  make_single_succ_edge(publish, use, EDGE_FALLTHRU);
+
+  // Another thread is decrypting, wait for it to publish the buffer.
+  tree current = make_reg(state_type, in_ssa);
+  call = gimple_build_call(load, 2, guard, acquire);
+  gimple_call_set_lhs(call, current);
+  gimple_stmt_iterator wait_gsi = gsi_last_bb(wait);
+  gsi_insert_after(&wait_gsi, call, GSI_NEW_STMT);
+  end_with_cond(wait, current, build_int_cst(state_type, DECRYPTED), use, wait,
+                profile_probability::likely());
+
+  // The statement is first in its block again.
+  *gsi = gsi_after_labels(use);
+}
+
+unsigned int STRPass::execute(function* f) {
+  if (!hellscape_enabled(f, "str", mEnable)) return 0;
+
+  // Not every front end has the atomic builtins.
+  if (!builtin_decl_explicit_p(BUILT_IN_ATOMIC_LOAD_4) ||
+      !builtin_decl_explicit_p(BUILT_IN_ATOMIC_STORE_4) ||
+      !builtin_decl_explicit_p(BUILT_IN_SYNC_VAL_COMPARE_AND_SWAP_4)) {
+    return 0;
+  }
+
+  // Splitting blocks in front of calls which may return twice is not safe.
+  if (f->calls_setjmp || f->has_nonlocal_label) return 0;
+
+  auto_client_timevar timevar("hellscape: str");
+  mBudget.begin(f);
+  Stats::Record record(mStats, f, "str");
+
+  bool in_ssa = gimple_in_ssa_p(f);
+
+  // Collect the uses first, decrypting splits the blocks they are in.
+  std::vector<std::pair<gimple*, unsigned>> uses;
+  basic_block bb;
+  FOR_EACH_BB_FN(bb, f) {
+    for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+      gimple* stmt = gsi_stmt(gsi);
+
+      // Debug info must not keep the plain literal alive.
+      if (is_gimple_debug(stmt)) {
+        if (gimple_debug_bind_p(stmt) && string_operand(gimple_debug_bind_get_value(stmt))) {
+          gimple_debug_bind_reset_value(stmt);
+          update_stmt(stmt);
+        }
+        continue;
+      }
+
+      if (gimple_code(stmt) == GIMPLE_ASM) continue;
+
+      // Array initializers copy the literal, e.g.: buf = "abc";
+      if (gimple_assign_single_p(stmt) && TREE_CODE(gimple_assign_rhs1(stmt)) == STRING_CST) {
+        uses.emplace_back(stmt, 1);
+        continue;
+      }
+
+      for (unsigned i = 0; i < gimple_num_ops(stmt); i++) {
+        if (string_operand(gimple_op(stmt, i))) uses.emplace_back(stmt, i);
+      }
+    }
+  }
+
+  // The guard is a 4 byte state, see insert_decrypt.
+  const Budget::Costs& costs = mBudget.costs(f, TYPE_MODE(unsigned_type_node));
+
+  bool changed = false;
+  for (auto& use : uses) {
+    gimple* stmt = use.first;
+    tree op = gimple_op(stmt, use.second);
+
+    bool copy = TREE_CODE(op) == STRING_CST;
+    const Literal* literal = this->literal(copy ? op : string_operand(op));
+    if (!literal) continue;
+    if (!mBudget.charge(f, gimple_bb(stmt), costs.check)) {
+      record.count("over_budget");
+      continue;
+    }
+
+    gimple_stmt_iterator gsi = gsi_for_stmt(stmt);
+    insert_decrypt(&gsi, *literal, in_ssa);
+
+    if (copy) {
+      // e.g.: buf = MEM <char[4]> [(unsigned char *)&strbuf.1];
+      tree offset = build_int_cst(build_pointer_type(unsigned_char_type_node), 0);
+      gimple_set_op(stmt, use.second, build2(MEM_REF, TREE_TYPE(op),
+                                             build_fold_addr_expr(literal->buffer), offset));
+    } else {
+      // e.g.: p = (const char *) &strbuf.1; puts (p);
+      tree pointer = make_reg(TREE_TYPE(op), in_ssa);
+      gsi_insert_before(&gsi, gimple_build_assign(pointer, NOP_EXPR,
+                                                  build_fold_addr_expr(literal->buffer)),
+                        GSI_SAME_STMT);
+      gimple_set_op(stmt, use.second, pointer);
+    }
+    update_stmt(stmt);
+
+    record.count("strings");
+    changed = true;
+  }
+
+  // In SSA form a literal can be a PHI argument as well, e.g.: p = PHI <&"abc"[0](2), q(3)>.
+  // Those are decrypted on an edge of their own in front of the PHI, all the
+  // PHIs of a block sharing it.
+  std::vector<edge> edges;
+  if (in_ssa) {
+    FOR_EACH_BB_FN(bb, f) {
+      for (gphi_iterator gsi = gsi_start_phis(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+        gphi* phi = gsi.phi();
+        for (unsigned i = 0; i < gimple_phi_num_args(phi); i++) {
+          edge e = gimple_phi_arg_edge(phi, i);
+          if (!string_operand(gimple_phi_arg_def(phi, i)) || (e->flags & EDGE_ABNORMAL)) continue;
+          if (std::find(edges.begin(), edges.end(), e) == edges.end()) edges.push_back(e);
+        }
+      }
+    }
+  }
+
+  for (edge e : edges) {
+    basic_block dest = e->dest;
+    // The edge into dest, whichever block ends up in front of it.
+    edge in = single_succ_edge(split_edge(e));
+
+    for (gphi_iterator gsi = gsi_start_phis(dest); !gsi_end_p(gsi); gsi_next(&gsi)) {
+      gphi* phi = gsi.phi();
+      tree op = PHI_ARG_DEF_FROM_EDGE(phi, in);
+      tree string = string_operand(op);
+      const Literal* literal = string ? this->literal(string) : nullptr;
+      if (!literal) continue;
+      if (!mBudget.charge(f, in->src, costs.check)) {
+        record.count("over_budget");
+        continue;
+      }
+
+      // e.g.: p_1 = (const char *) &strbuf.1; then p_2 = PHI <p_1(5), q(3)>
+      tree pointer = make_reg(TREE_TYPE(op), in_ssa);
+      gimple* stmt = gimple_build_assign(pointer, NOP_EXPR, build_fold_addr_expr(literal->buffer));
+      gimple_stmt_iterator use_gsi = gsi_last_bb(in->src);
+      gsi_insert_after(&use_gsi, stmt, GSI_NEW_STMT);
+      insert_decrypt(&use_gsi, *literal, in_ssa);
+      SET_USE(PHI_ARG_DEF_PTR_FROM_EDGE(phi, in), pointer);
+
+      record.count("strings");
+      changed = true;
+    }
+  }
+
+  if (!changed) return 0;
+
+  hellscape_done(f, "str");
+
+  // The decrypt and wait loops are new.
+  loops_state_set(LOOPS_NEED_FIXUP);
+  free_dominance_info(f, CDI_DOMINATORS);
+  free_dominance_info(f, CDI_POST_DOMINATORS);
+
+  // The loop index is a new variable and the atomics and the buffer accesses
+  // need virtual operands.
+  if (in_ssa) {
+    mark_virtual_operands_for_renaming(f);
+    return TODO_update_ssa;
+  }
+
+  return 0;
+}
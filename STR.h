@@ -0,0 +1,86 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gcc-plugin.h>
+#include <tree-pass.h>
+#include <context.h>
+#include <function.h>
+#include <tree.h>
+
+#include <map>
+#include <string>
+
+#include "Random.h"
+#include "Stats.h"
+#include "Budget.h"
+
+const pass_data str_pass_data = {
+  GIMPLE_PASS,
+  "str",
+
+  OPTGROUP_NONE,
+  TV_PLUGIN_RUN,
+  PROP_gimple_any,
+  0, 0, 0, 0
+};
+
+/**
+ * Encrypts string literals. Every distinct literal of the translation unit is
+ * stored encrypted and decrypted into a writable buffer once, on first use,
+ * behind a once-guard: the first thread to claim it decrypts and publishes the
+ * buffer with a release store, the others wait for it. Every use then only
+ * pays an acquire load (a plain load on most targets) and a branch before it
+ * takes the buffer's address.
+ */
+struct STRPass : gimple_opt_pass {
+  // The encrypted copy, the buffer and the guard of a literal.
+  struct Literal {
+    tree encrypted;
+    tree buffer;
+    tree guard;
+    uint32_t size;
+    uint32_t multiplier;
+    uint32_t offset;
+  };
+
+  Random& mRandom;
+  Stats& mStats;
+  Budget& mBudget;
+  // By contents, shared by all functions of the translation unit.
+  std::map<std::string, Literal> mLiterals;
+  bool mEnable;
+
+  STRPass(gcc::context* context, Random& random, Stats& stats, Budget& budget,
+          bool enable = true) : gimple_opt_pass(str_pass_data, context), mRandom(random),
+    mStats(stats), mBudget(budget), mEnable(enable) {
+  }
+
+  /**
+   * @param string literal
+   * @return its encrypted copy, created on first use, or nullptr if the
+   *         literal has no fixed size
+   */
+  const Literal* literal(tree string);
+
+  unsigned int execute(function* f) override;
+
+  STRPass* clone() override {
+    return this;
+  }
+};
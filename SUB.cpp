@@ -16,110 +16,540 @@
  */
 
 #include "SUB.h"
+#include "Attributes.h"
+#include "Loops.h"
 
 #include <function.h>
 #include <tree.h>
 #include <basic-block.h>
 
+#include <gimple-expr.h>
 #include <gimple.h>
-#include <gimple-pretty-print.h>
 #include <gimple-iterator.h>
-#include <gimplify-me.h>
+#include <ssa.h>
 
+#include <rtl.h>
+#include <predict.h>
+
+#include <algorithm>
+#include <climits>
 #include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Operands of a rule step: the inputs b and c, the result of an earlier step
+// (STEP + i), or the constant 1.
+static const int8_t B = 0;
+static const int8_t C = 1;
+static const int8_t STEP = 2;
+static const int8_t ONE = -1;
+static const int8_t NONE = -2;
+
+// Most steps in a rule.
+static const size_t MAX_STEPS = 5;
+
+struct Step {
+  tree_code code;
+  int8_t op1;
+  int8_t op2;
+};
+
+/**
+ * Rewrite of a = b <code> c (or a = <code> b) into a sequence of steps, the
+ * last of which computes a.
+ */
+struct Rule {
+  tree_code code;
+  size_t size;
+  Step steps[MAX_STEPS];
+};
+
+static const Rule rules[] = {
+  // b & c => (b ^ ~c) & b
+  {BIT_AND_EXPR, 3, {{BIT_NOT_EXPR, C, NONE}, {BIT_XOR_EXPR, B, STEP + 0}, {BIT_AND_EXPR, STEP + 1, B}}},
+  // b & c => (b + c) - (b | c)
+  {BIT_AND_EXPR, 3, {{PLUS_EXPR, B, C}, {BIT_IOR_EXPR, B, C}, {MINUS_EXPR, STEP + 0, STEP + 1}}},
+  // b & c => (b | c) ^ (b ^ c)
+  {BIT_AND_EXPR, 3, {{BIT_IOR_EXPR, B, C}, {BIT_XOR_EXPR, B, C}, {BIT_XOR_EXPR, STEP + 0, STEP + 1}}},
+
+  // b | c => (b & c) | (b ^ c)
+  {BIT_IOR_EXPR, 3, {{BIT_AND_EXPR, B, C}, {BIT_XOR_EXPR, B, C}, {BIT_IOR_EXPR, STEP + 0, STEP + 1}}},
+  // b | c => (b + c) - (b & c)
+  {BIT_IOR_EXPR, 3, {{PLUS_EXPR, B, C}, {BIT_AND_EXPR, B, C}, {MINUS_EXPR, STEP + 0, STEP + 1}}},
+  // b | c => (b ^ c) + (b & c)
+  {BIT_IOR_EXPR, 3, {{BIT_XOR_EXPR, B, C}, {BIT_AND_EXPR, B, C}, {PLUS_EXPR, STEP + 0, STEP + 1}}},
+  // b | c => ~(~b & ~c)
+  {BIT_IOR_EXPR, 4, {{BIT_NOT_EXPR, B, NONE}, {BIT_NOT_EXPR, C, NONE}, {BIT_AND_EXPR, STEP + 0, STEP + 1},
+                     {BIT_NOT_EXPR, STEP + 2, NONE}}},
+
+  // b ^ c => (~b & c) | (b & ~c)
+  {BIT_XOR_EXPR, 5, {{BIT_NOT_EXPR, B, NONE}, {BIT_AND_EXPR, STEP + 0, C}, {BIT_NOT_EXPR, C, NONE},
+                     {BIT_AND_EXPR, B, STEP + 2}, {BIT_IOR_EXPR, STEP + 1, STEP + 3}}},
+  // b ^ c => (b | c) - (b & c)
+  {BIT_XOR_EXPR, 3, {{BIT_IOR_EXPR, B, C}, {BIT_AND_EXPR, B, C}, {MINUS_EXPR, STEP + 0, STEP + 1}}},
+  // b ^ c => (b + c) - 2 * (b & c)
+  {BIT_XOR_EXPR, 4, {{PLUS_EXPR, B, C}, {BIT_AND_EXPR, B, C}, {PLUS_EXPR, STEP + 1, STEP + 1},
+                     {MINUS_EXPR, STEP + 0, STEP + 2}}},
+
+  // b + c => (b ^ c) + 2 * (b & c)
+  {PLUS_EXPR, 4, {{BIT_XOR_EXPR, B, C}, {BIT_AND_EXPR, B, C}, {PLUS_EXPR, STEP + 1, STEP + 1},
+                  {PLUS_EXPR, STEP + 0, STEP + 2}}},
+  // b + c => (b | c) + (b & c)
+  {PLUS_EXPR, 3, {{BIT_IOR_EXPR, B, C}, {BIT_AND_EXPR, B, C}, {PLUS_EXPR, STEP + 0, STEP + 1}}},
+  // b + c => (b - ~c) - 1
+  {PLUS_EXPR, 3, {{BIT_NOT_EXPR, C, NONE}, {MINUS_EXPR, B, STEP + 0}, {MINUS_EXPR, STEP + 1, ONE}}},
+  // b + c => 2 * (b | c) - (b ^ c)
+  {PLUS_EXPR, 4, {{BIT_IOR_EXPR, B, C}, {PLUS_EXPR, STEP + 0, STEP + 0}, {BIT_XOR_EXPR, B, C},
+                  {MINUS_EXPR, STEP + 1, STEP + 2}}},
+
+  // b - c => (b & ~c) - (~b & c)
+  {MINUS_EXPR, 5, {{BIT_NOT_EXPR, C, NONE}, {BIT_AND_EXPR, B, STEP + 0}, {BIT_NOT_EXPR, B, NONE},
+                   {BIT_AND_EXPR, STEP + 2, C}, {MINUS_EXPR, STEP + 1, STEP + 3}}},
+  // b - c => (b + ~c) + 1
+  {MINUS_EXPR, 3, {{BIT_NOT_EXPR, C, NONE}, {PLUS_EXPR, B, STEP + 0}, {PLUS_EXPR, STEP + 1, ONE}}},
+  // b - c => (b ^ c) - 2 * (~b & c)
+  {MINUS_EXPR, 5, {{BIT_XOR_EXPR, B, C}, {BIT_NOT_EXPR, B, NONE}, {BIT_AND_EXPR, STEP + 1, C},
+                   {PLUS_EXPR, STEP + 2, STEP + 2}, {MINUS_EXPR, STEP + 0, STEP + 3}}},
+
+  // -b => ~b + 1
+  {NEGATE_EXPR, 2, {{BIT_NOT_EXPR, B, NONE}, {PLUS_EXPR, STEP + 0, ONE}}},
+  // -b => ~(b - 1)
+  {NEGATE_EXPR, 2, {{MINUS_EXPR, B, ONE}, {BIT_NOT_EXPR, STEP + 0, NONE}}},
+};
+
+static const size_t RULES = sizeof(rules) / sizeof(rules[0]);
+
+size_t SUBPass::rule_count() {
+  return RULES;
+}
+
+/**
+ * @return the RTL code of a step
+ */
+static rtx_code rtx_code_for(tree_code code) {
+  switch (code) {
+  case PLUS_EXPR: return PLUS;
+  case MINUS_EXPR: return MINUS;
+  case BIT_AND_EXPR: return AND;
+  case BIT_IOR_EXPR: return IOR;
+  case BIT_XOR_EXPR: return XOR;
+  case BIT_NOT_EXPR: return NOT;
+  default: return NEG;
+  }
+}
+
+/**
+ * Cost a rule as the longest chain of dependent steps, each step costed as the
+ * RTL the target would see for it. A ~ only feeding &, | and ^ is costed as
+ * part of them, which is one instruction on targets with andn, bic, orn, etc.
+ *
+ * @param rule rule to cost
+ * @param mode mode of the statement
+ * @param speed whether to cost time rather than size
+ * @return the cost, in the units of the target's RTL costs
+ */
+static int rule_cost(const Rule& rule, machine_mode mode, bool speed) {
+  // Only registers, constants and vectors of those have meaningful costs.
+  if (!SCALAR_INT_MODE_P(mode) && !VECTOR_MODE_P(mode)) {
+    return COSTS_N_INSNS(rule.size);
+  }
+
+  bool folded[MAX_STEPS] = {};
+  for (size_t i = 0; i < rule.size; i++) {
+    if (rule.steps[i].code != BIT_NOT_EXPR) continue;
+
+    bool used = false;
+    bool foldable = true;
+    for (size_t j = i + 1; j < rule.size; j++) {
+      const Step& user = rule.steps[j];
+      if (user.op1 != (int8_t) (STEP + i) && user.op2 != (int8_t) (STEP + i)) continue;
+
+      used = true;
+      foldable &= user.code == BIT_AND_EXPR || user.code == BIT_IOR_EXPR ||
+                  user.code == BIT_XOR_EXPR;
+    }
+    folded[i] = used && foldable;
+  }
+
+  rtx values[STEP + MAX_STEPS];
+  int depths[STEP + MAX_STEPS] = {};
+  values[B] = gen_raw_REG(mode, LAST_VIRTUAL_REGISTER + 1);
+  values[C] = gen_raw_REG(mode, LAST_VIRTUAL_REGISTER + 2);
+
+  auto operand = [&](int8_t op, int* depth) -> rtx {
+    if (op == ONE) return CONST1_RTX(mode);
+    *depth = std::max(*depth, depths[op]);
+    return values[op];
+  };
+
+  for (size_t i = 0; i < rule.size; i++) {
+    const Step& step = rule.steps[i];
+    int depth = 0;
+    rtx op1 = operand(step.op1, &depth);
+    rtx op2 = step.op2 == NONE ? NULL_RTX : operand(step.op2, &depth);
+
+    rtx_code code = rtx_code_for(step.code);
+    rtx x = op2 ? gen_rtx_fmt_ee(code, mode, op1, op2) : gen_rtx_fmt_e(code, mode, op1);
+
+    // Its users see the ~ itself.
+    if (folded[i]) {
+      values[STEP + i] = x;
+      depths[STEP + i] = depth;
+      continue;
+    }
+
+    int cost = set_src_cost(x, mode, speed);
+    values[STEP + i] = gen_raw_REG(mode, LAST_VIRTUAL_REGISTER + 3 + i);
+    depths[STEP + i] = depth + std::max(cost, 1);
+  }
+
+  return depths[STEP + rule.size - 1];
+}
+
+const std::vector<int>& SUBPass::costs(function* f, tree type) {
+  tree target = DECL_FUNCTION_SPECIFIC_TARGET(f->decl);
+  machine_mode mode = TYPE_MODE(type);
+  bool speed = !optimize_function_for_size_p(f);
+
+  std::vector<int>& costs = mCosts[std::make_tuple(target, mode, speed)];
+  if (costs.empty()) {
+    for (const Rule& rule : rules) {
+      costs.push_back(rule_cost(rule, mode, speed));
+    }
+  }
+
+  return costs;
+}
+
+/**
+ * @return true if any step of the rule may overflow
+ */
+static bool is_arithmetic(const Rule& rule) {
+  for (size_t i = 0; i < rule.size; i++) {
+    tree_code code = rule.steps[i].code;
+    if (code == PLUS_EXPR || code == MINUS_EXPR || code == NEGATE_EXPR) return true;
+  }
+
+  return false;
+}
+
+/**
+ * @return true if some rule rewrites the statement
+ */
+static bool is_candidate(gimple* stmt) {
+  if (!is_gimple_assign(stmt)) return false;
+
+  tree_code code = gimple_assign_rhs_code(stmt);
+  if (code != BIT_AND_EXPR && code != BIT_IOR_EXPR && code != BIT_XOR_EXPR &&
+      code != PLUS_EXPR && code != MINUS_EXPR && code != NEGATE_EXPR) {
+    return false;
+  }
+
+  // Booleans, pointers and bit-fields are left alone, vectors are rewritten
+  // lane-wise.
+  tree type = TREE_TYPE(gimple_assign_lhs(stmt));
+  if (TREE_CODE(type) == VECTOR_TYPE) type = TREE_TYPE(type);
+  return TREE_CODE(type) == INTEGER_TYPE && type_has_mode_precision_p(type);
+}
+
+/**
+ * @return op converted to type, as an expression
+ */
+static tree convert_expr(tree type, tree op) {
+  return fold_build1(VECTOR_TYPE_P(type) ? VIEW_CONVERT_EXPR : NOP_EXPR, type, op);
+}
+
+/**
+ * @return a new register of the given type
+ */
+static tree make_reg(tree type, bool in_ssa) {
+  return in_ssa ? make_ssa_name(type) : create_tmp_reg(type, "sub");
+}
+
+/**
+ * @return op converted to type, converting in front of gsi if it is not a constant
+ */
+static tree convert_operand(gimple_stmt_iterator* gsi, tree type, tree op, bool in_ssa) {
+  if (useless_type_conversion_p(type, TREE_TYPE(op))) return op;
+
+  tree expr = convert_expr(type, op);
+  if (CONSTANT_CLASS_P(expr)) return expr;
+
+  tree reg = make_reg(type, in_ssa);
+  gsi_insert_before(gsi, gimple_build_assign(reg, expr), GSI_SAME_STMT);
+  return reg;
+}
+
+/**
+ * Rewrite the statement at gsi with a rule. Steps which may overflow are done
+ * in the unsigned type, so the rewrite has no undefined behaviour the original
+ * did not have.
+ *
+ * @param gsi statement to rewrite, the last step replaces it
+ * @param rule rule for the statement's code
+ * @param in_ssa whether the function is in SSA form
+ * @param emitted set to the statements computing the steps
+ */
+static void apply_rule(gimple_stmt_iterator* gsi, const Rule& rule, bool in_ssa,
+                       std::vector<gimple*>* emitted) {
+  gimple* stmt = gsi_stmt(*gsi);
+  tree type = TREE_TYPE(gimple_assign_lhs(stmt));
+  tree work = type;
+  if (is_arithmetic(rule) && !TYPE_OVERFLOW_WRAPS(type)) {
+    work = unsigned_type_for(type);
+  }
+  bool convert = work != type;
+
+  tree regs[STEP + MAX_STEPS];
+  regs[B] = convert_operand(gsi, work, gimple_assign_rhs1(stmt), in_ssa);
+  regs[C] = rule.code == NEGATE_EXPR
+            ? NULL_TREE
+            : convert_operand(gsi, work, gimple_assign_rhs2(stmt), in_ssa);
+
+  auto operand = [&](int8_t op) {
+    if (op == ONE) return build_one_cst(work);
+    if (op == NONE) return NULL_TREE;
+    return regs[op];
+  };
+
+  emitted->clear();
+  for (size_t i = 0; i < rule.size; i++) {
+    const Step& step = rule.steps[i];
+    tree op1 = operand(step.op1);
+    tree op2 = operand(step.op2);
+
+    // The last step takes the place of the original statement.
+    if (i == rule.size - 1 && !convert) {
+      gimple_assign_set_rhs_with_ops(gsi, step.code, op1, op2);
+      update_stmt(gsi_stmt(*gsi));
+      emitted->push_back(gsi_stmt(*gsi));
+      return;
+    }
+
+    regs[STEP + i] = make_reg(work, in_ssa);
+    gimple* assign = gimple_build_assign(regs[STEP + i], step.code, op1, op2);
+    gsi_insert_before(gsi, assign, GSI_SAME_STMT);
+    emitted->push_back(assign);
+  }
+
+  gimple_assign_set_rhs_from_tree(gsi, convert_expr(type, regs[STEP + rule.size - 1]));
+  update_stmt(gsi_stmt(*gsi));
+}
+
+/**
+ * Mix a value into an FNV-1a hash, byte by byte.
+ */
+static uint64_t hash_value(uint64_t h, uint64_t value) {
+  for (int i = 0; i < 8; i++) h = (h ^ ((value >> (i * 8)) & 0xff)) * 0x100000001b3;
+  return h;
+}
+
+static uint64_t hash_name(uint64_t h, tree decl) {
+  if (!decl || !DECL_P(decl) || !DECL_NAME(decl)) return h;
+
+  for (const char* c = IDENTIFIER_POINTER(DECL_NAME(decl)); *c; c++) {
+    h = (h ^ (uint8_t) *c) * 0x100000001b3;
+  }
+  return h;
+}
+
+/**
+ * Mix what an operand is into a hash: its code, constant value and the names
+ * of the variables it refers to, but not SSA versions or temporaries, which
+ * are numbered across the whole function.
+ */
+static uint64_t hash_operand(uint64_t h, tree op, int depth) {
+  if (!op) return hash_value(h, 0);
+
+  h = hash_value(h, TREE_CODE(op));
+  if (TREE_CODE(op) == INTEGER_CST) return hash_value(h, TREE_INT_CST_LOW(op));
+  if (TREE_CODE(op) == SSA_NAME) return hash_name(h, SSA_NAME_VAR(op));
+  if (DECL_P(op)) return hash_name(h, op);
+
+  // e.g.: &buf, MEM[(int *)p_1 + 4B], s.field
+  if (depth > 0 && (EXPR_P(op) || REFERENCE_CLASS_P(op))) {
+    for (int i = 0; i < TREE_OPERAND_LENGTH(op); i++) {
+      h = hash_operand(h, TREE_OPERAND(op, i), depth - 1);
+    }
+  }
+  return h;
+}
+
+/**
+ * Key the random stream of a block on what it computes. Its index changes
+ * whenever blocks are added or removed in front of it, its statements only
+ * when the block itself is edited. Debug statements and labels are left out,
+ * so -g does not change the rewrites either.
+ */
+static uint64_t block_hash(basic_block bb) {
+  uint64_t h = 0xcbf29ce484222325;
+  for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+    gimple* stmt = gsi_stmt(gsi);
+    if (is_gimple_debug(stmt) || gimple_code(stmt) == GIMPLE_LABEL) continue;
+
+    h = hash_value(h, gimple_code(stmt));
+    if (is_gimple_assign(stmt)) h = hash_value(h, gimple_assign_rhs_code(stmt));
+    for (unsigned i = 0; i < gimple_num_ops(stmt); i++) {
+      h = hash_operand(h, gimple_op(stmt, i), 2);
+    }
+  }
+
+  return h;
+}
 
 unsigned int SUBPass::execute(function* f) {
-  if (!mEnable) return 0;
-
-  for (uint32_t count = 0; count < mSubLoop; count++) {
-    basic_block bb;
-    // For all basic blocks.
-    FOR_ALL_BB_FN(bb, f) {
-      gimple_bb_info* bb_info = &bb->il.gimple;
-      // For all IR statements.
-      for (gimple_stmt_iterator i = gsi_start(bb_info->seq); !gsi_end_p(
-        i); gsi_next(&i)) {
-        gimple* gs = gsi_stmt(i);
-
-        if (is_gimple_assign(gs)) {
-          tree_code expr_code = gimple_expr_code(gs);
-
-          switch (expr_code) {
-          case BIT_AND_EXPR: {
-            /* a = b & c => a = (b ^ ~c) & b */
-            tree a = gimple_assign_lhs(gs);
-            tree b = gimple_assign_rhs1(gs);
-            tree c = gimple_assign_rhs2(gs);
-
-            tree not_c = build1(BIT_NOT_EXPR, TREE_TYPE(c), c);
-            tree left = build2(BIT_XOR_EXPR, TREE_TYPE(b), b, not_c);
-            tree res = build2(BIT_AND_EXPR, TREE_TYPE(left), left, b);
-
-            gimple* assign = gimple_build_assign(a,
-                                                 force_gimple_operand_gsi(&i,
-                                                                          res,
-                                                                          true,
-                                                                          NULL,
-                                                                          true,
-                                                                          GSI_SAME_STMT));
-            gimple_set_bb(assign, bb);
-            gsi_set_stmt(&i, assign);
-          }
-            break;
-          case BIT_IOR_EXPR: {
-            /* a = b | c => a = (b & c) | (b ^ c) */
-            tree a = gimple_assign_lhs(gs);
-            tree b = gimple_assign_rhs1(gs);
-            tree c = gimple_assign_rhs2(gs);
-
-            tree left = build2(BIT_AND_EXPR, TREE_TYPE(b), b, c);
-            tree right = build2(BIT_XOR_EXPR, TREE_TYPE(b), b, c);
-            tree res = build2(BIT_IOR_EXPR, TREE_TYPE(left), left, right);
-
-            // Force sub-expression expansion.
-            gimple* assign = gimple_build_assign(a,
-                                                 force_gimple_operand_gsi(&i,
-                                                                          res,
-                                                                          true,
-                                                                          NULL,
-                                                                          true,
-                                                                          GSI_SAME_STMT));
-            gimple_set_bb(assign, bb);
-            gsi_set_stmt(&i, assign);
-          }
-            break;
-          case BIT_XOR_EXPR: {
-            /* a = b ^ c => a = (~b & c) | (b & ~c) */
-            tree a = gimple_assign_lhs(gs);
-            tree b = gimple_assign_rhs1(gs);
-            tree c = gimple_assign_rhs2(gs);
-
-            tree left = build2(BIT_AND_EXPR, TREE_TYPE(b),
-                               build1(BIT_NOT_EXPR, TREE_TYPE(b), b), c);
-            tree right = build2(BIT_AND_EXPR, TREE_TYPE(b), b,
-                                build1(BIT_NOT_EXPR, TREE_TYPE(c), c));
-            tree res = build2(BIT_IOR_EXPR, TREE_TYPE(left), left, right);
-
-            gimple* assign = gimple_build_assign(a,
-                                                 force_gimple_operand_gsi(&i,
-                                                                          res,
-                                                                          true,
-                                                                          NULL,
-                                                                          true,
-                                                                          GSI_SAME_STMT));
-            gimple_set_bb(assign, bb);
-            gsi_set_stmt(&i, assign);
-          }
-            break;
-          default:
-            break;
-          }
-        }
+  if (!hellscape_enabled(f, "sub", mEnable)) return 0;
+
+  uint32_t subLoop = hellscape_sub_loop(f, mSubLoop);
+  if (subLoop == 0) return 0;
+
+  auto_client_timevar timevar("hellscape: sub");
+  mBudget.begin(f);
+  Stats::Record record(mStats, f, "sub");
+
+  bool in_ssa = gimple_in_ssa_p(f);
+
+  // Only innermost loops are vectorized, and only if the vectorizer runs.
+  bool vectorize = mVectorize && update_loops(f) &&
+                   (opt_for_fn(f->decl, flag_tree_loop_vectorize) || f->has_force_vectorize_loops);
+
+  // Collect the candidates in one walk, the statements a rewrite emits are
+  // handled right away below instead of in another walk over the function.
+  // Candidates in loops which may be vectorized are restricted to a single
+  // bitwise rewrite.
+  struct Candidate {
+    gimple* stmt;
+    bool restricted;
+    int block;
+    uint32_t key;
+  };
+  std::vector<Candidate> candidates;
+  // Blocks computing the same are told apart by their order among themselves.
+  std::map<uint64_t, uint32_t> seen;
+  basic_block bb;
+  FOR_EACH_BB_FN(bb, f) {
+    loop_p loop = vectorize ? innermost_loop(bb) : nullptr;
+    uint32_t key = 0;
+
+    for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+      gimple* stmt = gsi_stmt(gsi);
+      if (!is_candidate(stmt)) continue;
+
+      if (loop) {
+        // Arithmetic feeds induction variables and addresses, which the
+        // vectorizer has to be able to analyze.
+        tree_code code = gimple_assign_rhs_code(stmt);
+        if (code == PLUS_EXPR || code == MINUS_EXPR || code == NEGATE_EXPR) continue;
+        if (is_loop_carried(stmt, loop)) continue;
+      }
+
+      if (candidates.empty() || candidates.back().block != bb->index) {
+        uint64_t h = block_hash(bb);
+        key = (uint32_t) hash_value(h, seen[h]++);
       }
+      candidates.push_back({stmt, loop != nullptr, bb->index, key});
     }
   }
 
-//    GraphVizGFG(g).execute(f);
+  std::vector<std::pair<gimple*, uint32_t>> worklist;
+  std::vector<const Rule*> fitting;
+  std::vector<gimple*> emitted;
+
+  // Every block draws from its own stream, keyed on its contents, so editing
+  // one block leaves the rewrites of the others alone.
+  std::string symbol = hellscape_symbol(f);
+  Random::Stream random = mRandom.stream(symbol.c_str(), "sub");
+  int block = -1;
+
+  // Profiler mode counts the statements the rewrites of a candidate added,
+  // once per candidate.
+  tree counters = NULL_TREE;
+  bool changed = false;
+
+  for (auto& candidate : candidates) {
+    bool restricted = candidate.restricted;
+    if (candidate.block != block) {
+      block = candidate.block;
+      random = mRandom.stream(symbol.c_str(), "sub", candidate.key);
+    }
+    if (!mBudget.pick("sub", random)) continue;
+
+    // Each original statement grows into at most mMaxOps statements, and is
+    // rewritten at most subLoop levels deep.
+    uint32_t ops = 1;
+    uint32_t depth_limit = restricted ? 1 : subLoop;
+    gassign* count = nullptr;
+    worklist.clear();
+    worklist.emplace_back(candidate.stmt, 0);
+
+    while (!worklist.empty()) {
+      gimple* stmt = worklist.back().first;
+      uint32_t depth = worklist.back().second;
+      worklist.pop_back();
+
+      if (!is_candidate(stmt)) continue;
+
+      tree_code code = gimple_assign_rhs_code(stmt);
+      const std::vector<int>& cost = costs(f, TREE_TYPE(gimple_assign_lhs(stmt)));
+      int cheapest = INT_MAX;
+      fitting.clear();
+      for (size_t i = 0; i < RULES; i++) {
+        const Rule& rule = rules[i];
+        if (rule.code != code || ops + rule.size - 1 > mMaxOps) continue;
+        if (restricted && is_arithmetic(rule)) continue;
+        if (mRule >= 0 && i != (size_t) mRule) continue;
+
+        fitting.push_back(&rule);
+        cheapest = std::min(cheapest, cost[i]);
+      }
+
+      // Chains much longer than the cheapest rewrite's only add latency.
+      fitting.erase(std::remove_if(fitting.begin(), fitting.end(), [&](const Rule* rule) {
+        return cost[rule - rules] > cheapest + COSTS_N_INSNS(1);
+      }), fitting.end());
+      if (fitting.empty()) continue;
+
+      const Rule* choice = fitting[(uint32_t) random.nextInt() % fitting.size()];
+      // Fall back to the smallest rewrite once the size budget runs low.
+      if (!mBudget.fits(f, choice->size - 1)) {
+        choice = *std::min_element(fitting.begin(), fitting.end(), [](const Rule* a, const Rule* b) {
+          return a->size < b->size;
+        });
+      }
+
+      const Rule& rule = *choice;
+      if (!mBudget.charge(f, gimple_bb(stmt), rule.size - 1, rule.size - 1)) {
+        record.count("over_budget");
+        continue;
+      }
+
+      gimple_stmt_iterator gsi = gsi_for_stmt(stmt);
+      if (mInstrument.enabled() && !count) {
+        if (!counters) counters = mInstrument.counters(f);
+        count = mInstrument.count(f, &gsi, counters, Instrument::INSTRUCTIONS);
+      }
+      apply_rule(&gsi, rule, in_ssa, &emitted);
+      ops += rule.size - 1;
+      record.count("rewrites");
+      changed = true;
+      record.count("cost", cost[&rule - rules]);
+
+      if (depth + 1 < depth_limit) {
+        for (gimple* next : emitted) worklist.emplace_back(next, depth + 1);
+      }
+    }
+
+    if (count) {
+      gimple_assign_set_rhs2(count, build_int_cst(TREE_TYPE(gimple_assign_rhs2(count)), ops - 1));
+      update_stmt(count);
+    }
+  }
+
+  if (changed) hellscape_done(f, "sub");
+
+  // The counters are loaded and stored through memory.
+  if (counters && in_ssa) return TODO_update_ssa_only_virtuals;
 
   return 0;
 }
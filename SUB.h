@@ -22,29 +22,74 @@
 #include <context.h>
 #include <function.h>
 
+#include <map>
 #include <memory>
+#include <tuple>
+#include <vector>
 
 #include "Random.h"
+#include "Stats.h"
+#include "Budget.h"
+#include "Instrument.h"
 
 const pass_data sub_pass_data = {
   GIMPLE_PASS,
   "sub",
 
   OPTGROUP_NONE,
-  TV_NONE,
+  TV_PLUGIN_RUN,
   PROP_gimple_any,
   0, 0, 0, 0
 };
 
+/**
+ * Rewrites &, |, ^, +, - and unary - into equivalent (mixed boolean-arithmetic)
+ * sequences from a table of rules. Statements emitted by a rewrite are
+ * rewritten again, up to subLoop levels deep and maxOps statements in total
+ * per original statement. In vectorize mode, statements in innermost loops get
+ * at most one bitwise rewrite and induction variables and reductions none.
+ *
+ * Every rule is costed for the function's target and mode with the target's
+ * RTL costs, so e.g.: ~c & b counts as one instruction where there is andn or
+ * bic. A rewrite picks randomly among the rules within one instruction of the
+ * cheapest.
+ */
 struct SUBPass : gimple_opt_pass {
   Random& mRandom;
+  Stats& mStats;
+  Budget& mBudget;
+  Instrument& mInstrument;
   uint32_t mSubLoop;
+  uint32_t mMaxOps;
+  // Keep loops which may be vectorized vectorizable.
+  bool mVectorize;
+  // Only ever apply this rule, -1 for any, for measuring the rules.
+  int32_t mRule;
   bool mEnable;
+  // Cost of every rule by target options, mode and whether optimizing for speed.
+  std::map<std::tuple<tree, machine_mode, bool>, std::vector<int>> mCosts;
 
-  SUBPass(gcc::context* context, Random& random, uint32_t subLoop, bool enable = true) : gimple_opt_pass(
-    sub_pass_data, context), mRandom(random), mSubLoop(subLoop), mEnable(enable) {
+  SUBPass(gcc::context* context, Random& random, Stats& stats, Budget& budget,
+          Instrument& instrument, uint32_t subLoop, uint32_t maxOps, bool vectorize = false,
+          int32_t rule = -1, bool enable = true)
+    : gimple_opt_pass(sub_pass_data, context), mRandom(random), mStats(stats), mBudget(budget),
+      mInstrument(instrument), mSubLoop(subLoop), mMaxOps(maxOps), mVectorize(vectorize),
+      mRule(rule), mEnable(enable) {
   }
 
+  /**
+   * @return the number of rules, valid rules are 0 to rule_count() - 1
+   */
+  static size_t rule_count();
+
+  /**
+   * @param f function being rewritten
+   * @param type type of the statements
+   * @return the cost of every rule for f's target, in the units of the
+   *         target's RTL costs (COSTS_N_INSNS(1) per simple instruction)
+   */
+  const std::vector<int>& costs(function* f, tree type);
+
   unsigned int execute(function* f) override;
 
   SUBPass* clone() override {
@@ -0,0 +1,178 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Stats.h"
+
+#include <tree.h>
+#include <basic-block.h>
+#include <gimple.h>
+#include <gimple-iterator.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Count the blocks (without entry and exit) and non-debug statements of a
+ * function.
+ */
+static void count_function(function* f, uint64_t* blocks, uint64_t* statements) {
+  *blocks = n_basic_blocks_for_fn(f) - NUM_FIXED_BLOCKS;
+  *statements = 0;
+
+  basic_block bb;
+  FOR_EACH_BB_FN(bb, f) {
+    for (gimple_stmt_iterator gsi = gsi_start_nondebug_bb(bb); !gsi_end_p(gsi);
+         gsi_next_nondebug(&gsi)) {
+      (*statements)++;
+    }
+  }
+}
+
+/**
+ * Append a JSON string.
+ */
+static void append_string(std::string* out, const char* s) {
+  out->push_back('"');
+  for (const char* c = s; *c; c++) {
+    switch (*c) {
+    case '"':
+      out->append("\\\"");
+      break;
+    case '\\':
+      out->append("\\\\");
+      break;
+    case '\n':
+      out->append("\\n");
+      break;
+    default:
+      if ((unsigned char) *c < 0x20) {
+        char escape[8];
+        snprintf(escape, sizeof(escape), "\\u%04x", (unsigned) *c);
+        out->append(escape);
+      } else {
+        out->push_back(*c);
+      }
+    }
+  }
+  out->push_back('"');
+}
+
+/**
+ * Append "key":n.
+ */
+static void append_count(std::string* out, const char* key, uint64_t n) {
+  out->push_back(',');
+  append_string(out, key);
+  out->push_back(':');
+  out->append(std::to_string(n));
+}
+
+Stats::Record::Record(Stats& stats, function* f, const char* pass)
+  : mStats(stats), mFunction(f), mPass(pass) {
+  if (!mStats.enabled()) return;
+
+  count_function(f, &mBlocks, &mStatements);
+}
+
+Stats::Record::~Record() {
+  if (!mStats.enabled()) return;
+
+  uint64_t blocks, statements;
+  count_function(mFunction, &blocks, &statements);
+
+  // e.g.: {"tu":"a.c","function":"main","pass":"bcf","blocks_before":3,...}
+  std::string& out = mStats.mBuffer;
+  out.append("{\"tu\":");
+  append_string(&out, main_input_filename ? main_input_filename : "");
+  out.append(",\"function\":");
+  append_string(&out, function_name(mFunction));
+  if (DECL_ASSEMBLER_NAME_SET_P(mFunction->decl)) {
+    out.append(",\"symbol\":");
+    append_string(&out, IDENTIFIER_POINTER(DECL_ASSEMBLER_NAME(mFunction->decl)));
+  }
+  out.append(",\"pass\":");
+  append_string(&out, mPass);
+
+  append_count(&out, "blocks_before", mBlocks);
+  append_count(&out, "blocks_after", blocks);
+  append_count(&out, "stmts_before", mStatements);
+  append_count(&out, "stmts_after", statements);
+  for (auto& counter : mCounters) {
+    append_count(&out, counter.first, counter.second);
+  }
+
+  out.append("}\n");
+}
+
+void Stats::Record::count(const char* counter, uint64_t n) {
+  if (!mStats.enabled()) return;
+
+  for (auto& c : mCounters) {
+    if (strcmp(c.first, counter) == 0) {
+      c.second += n;
+      return;
+    }
+  }
+
+  mCounters.emplace_back(counter, n);
+}
+
+Stats::~Stats() {
+  if (mFd >= 0) ::close(mFd);
+}
+
+bool Stats::open(const char* path, std::string* error) {
+  int fd = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    *error = std::string("cannot open ") + path + ": " + strerror(errno);
+    return false;
+  }
+
+  if (mFd >= 0) ::close(mFd);
+  mFd = fd;
+  mPath = path;
+  return true;
+}
+
+bool Stats::flush(std::string* error) {
+  if (!enabled() || mBuffer.empty()) return true;
+
+  // O_APPEND seeks and writes atomically, one write keeps the lines of this
+  // translation unit together. Only an interrupted or partial write (e.g.: a
+  // full disk) is continued with another one.
+  const char* data = mBuffer.data();
+  size_t size = mBuffer.size();
+  while (size > 0) {
+    ssize_t written = ::write(mFd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+
+      *error = std::string("cannot write ") + mPath + ": " + strerror(errno);
+      return false;
+    }
+
+    data += written;
+    size -= written;
+  }
+
+  mBuffer.clear();
+  return true;
+}
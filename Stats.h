@@ -0,0 +1,96 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gcc-plugin.h>
+#include <function.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Per-function, per-pass statistics for -fplugin-arg-hellscape-stats=<path>.
+ *
+ * Records are JSON lines, buffered for the whole translation unit and appended
+ * with a single write on an O_APPEND descriptor at the end, so any number of
+ * parallel compilers can share one file without locks or interleaved lines.
+ */
+class Stats {
+public:
+  /**
+   * Counts a function before and after a pass runs on it, created after the
+   * pass decided to transform the function. The record is added when it goes
+   * out of scope.
+   */
+  class Record {
+  public:
+    Record(Stats& stats, function* f, const char* pass);
+    ~Record();
+
+    Record(const Record&) = delete;
+    Record& operator=(const Record&) = delete;
+
+    /**
+     * @param counter pass specific counter, e.g.: "predicates"
+     * @param n amount to add
+     */
+    void count(const char* counter, uint64_t n = 1);
+
+  private:
+    Stats& mStats;
+    function* mFunction;
+    const char* mPass;
+    uint64_t mBlocks = 0;
+    uint64_t mStatements = 0;
+    std::vector<std::pair<const char*, uint64_t>> mCounters;
+  };
+
+  Stats() = default;
+  ~Stats();
+
+  Stats(const Stats&) = delete;
+  Stats& operator=(const Stats&) = delete;
+
+  /**
+   * Enable the statistics.
+   *
+   * @param path file to append to, created if needed
+   * @param error set to the reason on failure
+   * @return false on failure
+   */
+  bool open(const char* path, std::string* error);
+
+  bool enabled() const {
+    return mFd >= 0;
+  }
+
+  /**
+   * Append the records of the translation unit.
+   *
+   * @param error set to the reason on failure
+   * @return false on failure
+   */
+  bool flush(std::string* error);
+
+private:
+  int mFd = -1;
+  std::string mPath;
+  std::string mBuffer;
+};
@@ -0,0 +1,46 @@
+# Compares the shared objects hellscape-check-relocs built with N and 2N
+# BCF-obfuscated functions, e.g.:
+#   cmake -DREADELF=readelf -DSMALL=relocs-8.so -DLARGE=relocs-16.so -DADDED=8 -P Relocs.cmake
+#
+# The guards read the opaque globals through hidden, PC-relative references, so
+# the extra functions may add their own dynamic symbols but no relocations.
+
+foreach(var READELF SMALL LARGE ADDED)
+  if(NOT DEFINED ${var})
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+
+# Counts the entries (lines starting with an offset or an index) readelf lists
+# for object into out, and fails if the opaque globals are among them.
+function(count_entries out flag object)
+  execute_process(COMMAND ${READELF} ${flag} --wide ${object}
+                  OUTPUT_VARIABLE listing RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${READELF} ${flag} ${object} failed")
+  endif()
+
+  string(REGEX MATCHALL "\n *[0-9a-f]+:? +[^\n]*" entries "${listing}")
+  list(LENGTH entries count)
+  set(${out} ${count} PARENT_SCOPE)
+
+  if(listing MATCHES "[$][xy]")
+    message(FATAL_ERROR "${object}: the opaque globals show up in ${READELF} ${flag}")
+  endif()
+endfunction()
+
+count_entries(small_relocs -r ${SMALL})
+count_entries(large_relocs -r ${LARGE})
+count_entries(small_symbols --dyn-syms ${SMALL})
+count_entries(large_symbols --dyn-syms ${LARGE})
+
+math(EXPR added_symbols "${large_symbols} - ${small_symbols}")
+message(STATUS "relocations: ${small_relocs} -> ${large_relocs}, "
+               "dynamic symbols: ${small_symbols} -> ${large_symbols}")
+
+if(large_relocs GREATER small_relocs)
+  message(FATAL_ERROR "dynamic relocations grow with the number of obfuscated functions")
+endif()
+if(added_symbols GREATER ADDED)
+  message(FATAL_ERROR "${added_symbols} dynamic symbols for ${ADDED} more functions")
+endif()
@@ -0,0 +1,322 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// COSTS_N_INSNS(1), the RTL cost of one simple instruction.
+static const double INSN_COST = 4;
+
+struct Chain {
+  std::string function;
+  double ns;
+  std::string result;
+};
+
+struct Sample {
+  uint32_t rule;
+  std::string function;
+  // Predicted and measured cost per rewritten operation, over the original.
+  double predicted;
+  double measured;
+};
+
+/**
+ * Find the value of "key": in a JSON line.
+ *
+ * @return the raw value (a number or a quoted string without the quotes),
+ * empty if missing
+ */
+static std::string field(const std::string& line, const std::string& key) {
+  std::string needle = "\"" + key + "\":";
+  size_t pos = line.find(needle);
+  if (pos == std::string::npos) return "";
+
+  pos += needle.size();
+  if (line[pos] == '"') {
+    size_t end = line.find('"', pos + 1);
+    return line.substr(pos + 1, end - pos - 1);
+  }
+
+  size_t end = line.find_first_of(",}", pos);
+  return line.substr(pos, end - pos);
+}
+
+/**
+ * Run a command, with stderr going to /dev/null if quiet.
+ *
+ * @return false if it failed
+ */
+static bool spawn(const std::vector<std::string>& args, bool quiet) {
+  std::vector<char*> argv;
+  for (auto& arg : args) argv.push_back((char*) arg.c_str());
+  argv.push_back(nullptr);
+
+  pid_t pid = fork();
+  if (pid < 0) return false;
+  if (pid == 0) {
+    if (quiet) freopen("/dev/null", "w", stderr);
+    execvp(argv[0], argv.data());
+    _exit(127);
+  }
+
+  int status;
+  if (waitpid(pid, &status, 0) != pid) return false;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Run a build of the rules harness and collect the chains it measured.
+ *
+ * @return false if it failed
+ */
+static bool run(const std::string& binary, uint64_t iterations, std::vector<Chain>* chains) {
+  FILE* out = popen(("'" + binary + "' " + std::to_string(iterations)).c_str(), "r");
+  if (!out) return false;
+
+  char buffer[1024];
+  while (fgets(buffer, sizeof(buffer), out)) {
+    std::string line = buffer;
+
+    Chain chain;
+    chain.function = field(line, "function");
+    chain.ns = strtod(field(line, "ns").c_str(), nullptr);
+    chain.result = field(line, "result");
+    if (!chain.function.empty()) chains->push_back(chain);
+  }
+
+  return pclose(out) == 0 && !chains->empty();
+}
+
+/**
+ * @return the rank of every value, ties getting the mean of their ranks
+ */
+static std::vector<double> ranks(const std::vector<double>& values) {
+  std::vector<size_t> order(values.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return values[a] < values[b];
+  });
+
+  std::vector<double> rank(values.size());
+  for (size_t i = 0; i < order.size();) {
+    size_t j = i;
+    while (j + 1 < order.size() && values[order[j + 1]] == values[order[i]]) j++;
+    for (size_t k = i; k <= j; k++) rank[order[k]] = (i + j) / 2.0;
+    i = j + 1;
+  }
+
+  return rank;
+}
+
+/**
+ * Spearman's rank correlation, the Pearson correlation of the ranks.
+ */
+static double spearman(const std::vector<double>& x, const std::vector<double>& y) {
+  std::vector<double> rx = ranks(x), ry = ranks(y);
+  double n = x.size(), mx = 0, my = 0;
+  for (size_t i = 0; i < x.size(); i++) {
+    mx += rx[i] / n;
+    my += ry[i] / n;
+  }
+
+  double sxy = 0, sxx = 0, syy = 0;
+  for (size_t i = 0; i < x.size(); i++) {
+    sxy += (rx[i] - mx) * (ry[i] - my);
+    sxx += (rx[i] - mx) * (rx[i] - mx);
+    syy += (ry[i] - my) * (ry[i] - my);
+  }
+
+  return sxx == 0 || syy == 0 ? 0 : sxy / std::sqrt(sxx * syy);
+}
+
+static void usage(const char* name) {
+  std::cerr << "usage: " << name << " --plugin <hellscape.so> --source <bench dir>\n"
+            << "       [--cc <gcc>] [--dir <dir>] [--iterations <n>]\n"
+            << "       [--min-correlation <r>] [--json <file>]\n";
+}
+
+/**
+ * Builds rules_kernel.c once without the plugin and once per substitution
+ * rule, forcing it with subRule, and compares the cost the plugin predicted
+ * for every rule (the "cost" counter over the "rewrites" in its stats) with
+ * the time the rule adds per operation. Fails if a build gives other results
+ * than the baseline or if the rank correlation between the two is below
+ * --min-correlation.
+ */
+int main(int argc, char** argv) {
+  std::string cc = "gcc";
+  std::string plugin;
+  std::string source;
+  std::string dir = "rules";
+  std::string jsonPath = "rules.json";
+  uint64_t iterations = 2000000;
+  double minCorrelation = 0.3;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+
+    std::string value = argv[++i];
+    if (arg == "--cc") {
+      cc = value;
+    } else if (arg == "--plugin") {
+      plugin = value;
+    } else if (arg == "--source") {
+      source = value;
+    } else if (arg == "--dir") {
+      dir = value;
+    } else if (arg == "--json") {
+      jsonPath = value;
+    } else if (arg == "--iterations") {
+      iterations = strtoull(value.c_str(), nullptr, 10);
+    } else if (arg == "--min-correlation") {
+      minCorrelation = strtod(value.c_str(), nullptr);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (plugin.empty() || source.empty() || iterations == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  mkdir(dir.c_str(), 0755);
+
+  std::string harness = source + "/rules.c";
+  std::string kernel = source + "/rules_kernel.c";
+  std::string include = "-I" + source;
+
+  std::string baselineBinary = dir + "/rules-baseline";
+  std::vector<Chain> baseline;
+  if (!spawn({cc, "-O2", include, harness, kernel, "-o", baselineBinary}, false) ||
+      !run(baselineBinary, iterations, &baseline)) {
+    std::cerr << "error: baseline failed\n";
+    return 1;
+  }
+
+  std::map<std::string, const Chain*> byFunction;
+  for (const Chain& chain : baseline) byFunction[chain.function] = &chain;
+
+  // subRule rejects the first rule past the last, which ends the loop.
+  std::vector<Sample> samples;
+  for (uint32_t rule = 0;; rule++) {
+    std::string name = dir + "/rules-" + std::to_string(rule);
+    std::string stats = name + ".jsonl";
+    unlink(stats.c_str());
+
+    std::vector<std::string> args = {
+      cc, "-O2", include, "-c", kernel, "-o", name + ".o",
+      "-fplugin=" + plugin, "-fplugin-arg-hellscape-seed=deadbeef",
+      "-fplugin-arg-hellscape-sub", "-fplugin-arg-hellscape-subRule=" + std::to_string(rule),
+      "-fplugin-arg-hellscape-stats=" + stats,
+    };
+    if (!spawn(args, rule > 0)) {
+      if (rule == 0) {
+        std::cerr << "error: rule 0 failed to compile\n";
+        return 1;
+      }
+      break;
+    }
+
+    std::vector<Chain> chains;
+    if (!spawn({cc, "-O2", include, harness, name + ".o", "-o", name}, false) ||
+        !run(name, iterations, &chains)) {
+      std::cerr << "error: rule " << rule << " failed\n";
+      return 1;
+    }
+
+    // The rule only rewrites the operation of one chain.
+    std::ifstream in(stats);
+    std::string line;
+    while (std::getline(in, line)) {
+      uint64_t rewrites = strtoull(field(line, "rewrites").c_str(), nullptr, 10);
+      if (field(line, "pass") != "sub" || rewrites == 0) continue;
+
+      std::string function = field(line, "function");
+      auto it = byFunction.find(function);
+      if (it == byFunction.end()) continue;
+
+      for (const Chain& chain : chains) {
+        if (chain.function != function) continue;
+        if (chain.result != it->second->result) {
+          std::cerr << "error: rule " << rule << " changed the result of " << function << "\n";
+          return 1;
+        }
+
+        double cost = strtod(field(line, "cost").c_str(), nullptr);
+        samples.push_back({rule, function, cost / rewrites / INSN_COST,
+                           chain.ns - it->second->ns});
+      }
+    }
+  }
+
+  if (samples.size() < 2) {
+    std::cerr << "error: no rule rewrote anything\n";
+    return 1;
+  }
+
+  std::cout << std::left << std::setw(6) << "rule" << std::setw(12) << "function" << std::right
+            << std::setw(12) << "insns" << std::setw(12) << "+ns/op" << "\n";
+
+  std::vector<double> predicted, measured;
+  std::ostringstream json;
+  json << "{\"rules\":[";
+  for (size_t i = 0; i < samples.size(); i++) {
+    const Sample& sample = samples[i];
+    predicted.push_back(sample.predicted);
+    measured.push_back(sample.measured);
+
+    std::cout << std::left << std::setw(6) << sample.rule << std::setw(12) << sample.function
+              << std::right << std::fixed << std::setprecision(2) << std::setw(12)
+              << sample.predicted << std::setw(12) << sample.measured << "\n";
+
+    json << (i ? "," : "") << "\n{\"rule\":" << sample.rule << ",\"function\":\""
+         << sample.function << "\",\"predicted_insns\":" << sample.predicted
+         << ",\"measured_ns\":" << sample.measured << "}";
+  }
+
+  double correlation = spearman(predicted, measured);
+  bool ok = correlation >= minCorrelation;
+  std::cout << "spearman " << std::setprecision(3) << correlation << " (minimum "
+            << minCorrelation << ")" << (ok ? "" : "  TOO LOW") << "\n";
+
+  json << "\n],\"spearman\":" << correlation << ",\"min_correlation\":" << minCorrelation
+       << "}\n";
+  std::ofstream(jsonPath) << json.str();
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,289 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <elf.h>
+
+// Fields the harness prints per kernel, besides "kernel" and "checksum".
+static const char* const fields[] = {
+  "ns", "instructions", "branch_misses", "itlb_misses", "icache_misses",
+};
+
+static const size_t FIELDS = sizeof(fields) / sizeof(fields[0]);
+
+struct Result {
+  std::string kernel;
+  std::string checksum;
+  // Negative if the counter was not available.
+  double values[FIELDS];
+};
+
+struct Build {
+  std::string name;
+  std::string path;
+  uint64_t text = 0;
+  // Bytes of .text in split off cold parts.
+  uint64_t cold = 0;
+  std::vector<Result> results;
+};
+
+/**
+ * Find the value of "key": in a line printed by the harness.
+ *
+ * @return the raw value (a number, null or a quoted string without the
+ * quotes), empty if missing
+ */
+static std::string field(const std::string& line, const std::string& key) {
+  std::string needle = "\"" + key + "\":";
+  size_t pos = line.find(needle);
+  if (pos == std::string::npos) return "";
+
+  pos += needle.size();
+  if (line[pos] == '"') {
+    size_t end = line.find('"', pos + 1);
+    return line.substr(pos + 1, end - pos - 1);
+  }
+
+  size_t end = line.find_first_of(",}", pos);
+  return line.substr(pos, end - pos);
+}
+
+/**
+ * Measure the .text section of an ELF file and the function parts GCC split
+ * off into .text.unlikely (foo.cold), which the linker places in .text too.
+ * Both stay 0 if there are none.
+ */
+template <typename Ehdr, typename Shdr, typename Sym>
+static void code_size(const std::string& image, uint64_t* text, uint64_t* cold) {
+  if (image.size() < sizeof(Ehdr)) return;
+
+  auto* ehdr = (const Ehdr*) image.data();
+  if (ehdr->e_shoff == 0 || ehdr->e_shstrndx >= ehdr->e_shnum ||
+      ehdr->e_shoff + (uint64_t) ehdr->e_shnum * sizeof(Shdr) > image.size()) {
+    return;
+  }
+
+  auto* shdrs = (const Shdr*) (image.data() + ehdr->e_shoff);
+  const Shdr& strtab = shdrs[ehdr->e_shstrndx];
+  for (unsigned i = 0; i < ehdr->e_shnum; i++) {
+    uint64_t name = strtab.sh_offset + shdrs[i].sh_name;
+    if (name + sizeof(".text") > image.size()) continue;
+
+    if (strcmp(image.data() + name, ".text") == 0) *text = shdrs[i].sh_size;
+  }
+
+  for (unsigned i = 0; i < ehdr->e_shnum; i++) {
+    const Shdr& symtab = shdrs[i];
+    if (symtab.sh_type != SHT_SYMTAB || symtab.sh_link >= ehdr->e_shnum) continue;
+    if (symtab.sh_offset + symtab.sh_size > image.size()) continue;
+
+    const Shdr& names = shdrs[symtab.sh_link];
+    auto* syms = (const Sym*) (image.data() + symtab.sh_offset);
+    for (size_t j = 0; j < symtab.sh_size / sizeof(Sym); j++) {
+      uint64_t name = names.sh_offset + syms[j].st_name;
+      if (name >= image.size() || (syms[j].st_info & 0xf) != STT_FUNC) continue;
+
+      // Bounded by the end of the image, a truncated name just doesn't match.
+      size_t length = strnlen(image.data() + name, image.size() - name);
+      if (std::string(image.data() + name, length).find(".cold") != std::string::npos) {
+        *cold += syms[j].st_size;
+      }
+    }
+  }
+}
+
+static void code_size(const std::string& path, uint64_t* text, uint64_t* cold) {
+  std::ifstream in(path, std::ios::binary);
+  std::string image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (image.size() < EI_NIDENT || memcmp(image.data(), ELFMAG, SELFMAG) != 0) return;
+
+  if (image[EI_CLASS] == ELFCLASS64) {
+    code_size<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym>(image, text, cold);
+  } else {
+    code_size<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym>(image, text, cold);
+  }
+}
+
+/**
+ * @return part as a percentage of whole, as text
+ */
+static std::string share(uint64_t part, uint64_t whole) {
+  if (whole == 0) return "-";
+
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1) << 100.0 * part / whole << "%";
+  return out.str();
+}
+
+/**
+ * Run a build of the harness and collect its results.
+ *
+ * @return false if it failed
+ */
+static bool run(Build* build) {
+  FILE* out = popen(("'" + build->path + "'").c_str(), "r");
+  if (!out) return false;
+
+  char buffer[1024];
+  while (fgets(buffer, sizeof(buffer), out)) {
+    std::string line = buffer;
+
+    Result result;
+    result.kernel = field(line, "kernel");
+    result.checksum = field(line, "checksum");
+    if (result.kernel.empty()) continue;
+
+    for (size_t i = 0; i < FIELDS; i++) {
+      std::string value = field(line, fields[i]);
+      result.values[i] = value.empty() || value == "null" ? -1 : strtod(value.c_str(), nullptr);
+    }
+
+    build->results.push_back(result);
+  }
+
+  return pclose(out) == 0;
+}
+
+/**
+ * @return the overhead of value over baseline in percent, as text
+ */
+static std::string overhead(double value, double baseline) {
+  if (value < 0 || baseline <= 0) return "-";
+
+  std::ostringstream out;
+  out << std::showpos << std::fixed << std::setprecision(1)
+      << 100.0 * (value - baseline) / baseline << "%";
+  return out.str();
+}
+
+/**
+ * Usage: hellscape-bench-runner <json> baseline=<harness> <name>=<harness>...
+ *
+ * Runs every build of the benchmark harness, prints the overhead of each
+ * against the baseline as a table and writes all results to <json>.
+ * Fails if a build computes different results than the baseline.
+ */
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " <json> baseline=<harness> <name>=<harness>...\n";
+    return 1;
+  }
+
+  std::vector<Build> builds;
+  for (int i = 2; i < argc; i++) {
+    const char* eq = strchr(argv[i], '=');
+    if (!eq) {
+      std::cerr << "error: expected <name>=<harness>, got " << argv[i] << "\n";
+      return 1;
+    }
+
+    Build build;
+    build.name = std::string(argv[i], eq - argv[i]);
+    build.path = eq + 1;
+    builds.push_back(build);
+  }
+
+  if (builds[0].name != "baseline") {
+    std::cerr << "error: the first build must be the baseline\n";
+    return 1;
+  }
+
+  bool ok = true;
+  for (Build& build : builds) {
+    std::cerr << "running " << build.name << "\n";
+    code_size(build.path, &build.text, &build.cold);
+    if (!run(&build)) {
+      std::cerr << "error: " << build.path << " failed\n";
+      return 1;
+    }
+  }
+
+  const Build& baseline = builds[0];
+  std::map<std::string, const Result*> reference;
+  for (const Result& result : baseline.results) {
+    reference[result.kernel] = &result;
+  }
+
+  std::cout << std::left << std::setw(24) << "build" << std::setw(12) << "kernel"
+            << std::right << std::setw(14) << "ns" << std::setw(10) << "time"
+            << std::setw(10) << "insns" << std::setw(10) << "br-miss"
+            << std::setw(10) << "itlb" << std::setw(10) << "icache"
+            << std::setw(10) << ".text" << std::setw(8) << "cold" << "\n";
+
+  for (const Build& build : builds) {
+    for (const Result& result : build.results) {
+      auto it = reference.find(result.kernel);
+      const Result* base = it == reference.end() ? nullptr : it->second;
+      if (base && base->checksum != result.checksum) {
+        std::cerr << "error: " << build.name << " computes " << result.checksum << " in "
+                  << result.kernel << ", the baseline " << base->checksum << "\n";
+        ok = false;
+      }
+
+      std::cout << std::left << std::setw(24) << build.name << std::setw(12) << result.kernel
+                << std::right << std::setw(14) << std::fixed << std::setprecision(0)
+                << result.values[0];
+      for (size_t i = 0; i < FIELDS; i++) {
+        std::cout << std::setw(10) << (base ? overhead(result.values[i], base->values[i]) : "-");
+      }
+      std::cout << std::setw(10) << overhead(build.text, baseline.text)
+                << std::setw(8) << share(build.cold, build.text) << "\n";
+    }
+  }
+
+  std::ofstream json(argv[1]);
+  json << "{\"builds\":[";
+  for (size_t b = 0; b < builds.size(); b++) {
+    const Build& build = builds[b];
+    json << (b ? "," : "") << "\n{\"name\":\"" << build.name << "\",\"text\":" << build.text
+         << ",\"cold\":" << build.cold << ",\"kernels\":[";
+    for (size_t r = 0; r < build.results.size(); r++) {
+      const Result& result = build.results[r];
+      json << (r ? "," : "") << "{\"kernel\":\"" << result.kernel << "\",\"checksum\":\""
+           << result.checksum << "\"";
+      for (size_t i = 0; i < FIELDS; i++) {
+        json << ",\"" << fields[i] << "\":";
+        if (result.values[i] < 0) {
+          json << "null";
+        } else {
+          json << std::fixed << std::setprecision(1) << result.values[i];
+        }
+      }
+      json << "}";
+    }
+    json << "]}";
+  }
+  json << "\n]}\n";
+
+  if (!json) {
+    std::cerr << "error: cannot write " << argv[1] << "\n";
+    return 1;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,482 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * A family of generated C files, the size being the number of functions,
+ * statements, cases, etc.
+ */
+struct Shape {
+  const char* name;
+  uint32_t base;
+  std::function<void(std::ostream&, uint32_t)> generate;
+};
+
+struct Config {
+  std::string name;
+  std::vector<std::string> flags;
+};
+
+struct Sample {
+  uint32_t size;
+  double seconds;
+  double rssMB;
+};
+
+// Basic blocks per statement of huge_function: the condition, then and else.
+static const uint32_t HUGE_BLOCKS_PER_STMT = 3;
+
+/**
+ * Deterministic LCG for the constants in generated code.
+ */
+static uint32_t next(uint32_t* state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+/**
+ * One function of n if/else statements.
+ */
+static void huge_function(std::ostream& out, uint32_t n) {
+  uint32_t r = 2;
+  out << "int huge(const int* a, int x) {\n";
+  for (uint32_t i = 0; i < n; i++) {
+    out << "  if (a[" << next(&r) % 64 << "] > " << next(&r) % 100 << ") x += a["
+        << next(&r) % 64 << "]; else x ^= " << next(&r) % 1000 << ";\n";
+  }
+  out << "  return x;\n}\n";
+}
+
+static const Shape shapes[] = {
+  {"many_small", 250, [](std::ostream& out, uint32_t n) {
+    uint32_t r = 1;
+    for (uint32_t i = 0; i < n; i++) {
+      out << "int f" << i << "(int x, int y) {\n"
+          << "  if (x > y) return (x ^ " << next(&r) % 1000 << ") & y;\n"
+          << "  return (x | " << next(&r) % 1000 << ") + y;\n"
+          << "}\n";
+    }
+  }},
+  {"huge_function", 500, huge_function},
+  {"if_ladder", 250, [](std::ostream& out, uint32_t n) {
+    uint32_t r = 3;
+    out << "int ladder(int x) {\n  if (x == 0) return 0;\n";
+    for (uint32_t i = 1; i < n; i++) {
+      out << "  else if (x == " << i << ") return " << next(&r) % 1000 << ";\n";
+    }
+    out << "  return -1;\n}\n";
+  }},
+  {"big_switch", 250, [](std::ostream& out, uint32_t n) {
+    uint32_t r = 4;
+    out << "int dispatch(int x, int y) {\n  switch (x) {\n";
+    for (uint32_t i = 0; i < n; i++) {
+      out << "  case " << i << ": y = (y ^ " << next(&r) % 1000 << ") + " << next(&r) % 100
+          << "; break;\n";
+    }
+    out << "  default: y = -y;\n  }\n  return y;\n}\n";
+  }},
+  {"nested_loops", 50, [](std::ostream& out, uint32_t n) {
+    out << "int loops(const int* a, int n) {\n  int s = 0;\n";
+    for (uint32_t i = 0; i < n; i++) {
+      out << "  for (int i" << i << " = 0; i" << i << " < n; i" << i << "++)\n"
+          << "    for (int j" << i << " = 0; j" << i << " < n; j" << i << "++)\n"
+          << "      for (int k" << i << " = 0; k" << i << " < n; k" << i << "++)\n"
+          << "        s += (a[i" << i << "] * a[j" << i << "]) ^ k" << i << ";\n";
+    }
+    out << "  return s;\n}\n";
+  }},
+  {"bitwise", 500, [](std::ostream& out, uint32_t n) {
+    uint32_t r = 5;
+    static const char* vars[] = {"x", "y", "z", "w"};
+    out << "unsigned mix(unsigned x, unsigned y, unsigned z, unsigned w) {\n";
+    for (uint32_t i = 0; i < n; i++) {
+      out << "  " << vars[i % 4] << " = (" << vars[(i + 1) % 4] << " ^ " << vars[(i + 2) % 4]
+          << ") & (" << vars[(i + 3) % 4] << " | " << next(&r) << "u) - " << vars[i % 4] << ";\n";
+    }
+    out << "  return x + y + z + w;\n}\n";
+  }},
+};
+
+/**
+ * Compile a file and measure the wall time and the peak RSS of the compiler
+ * (the largest of the driver and cc1, which wait4 reports for the driver).
+ *
+ * @param log if not empty, where the compiler's stderr goes
+ * @return false if the compiler failed
+ */
+static bool compile(const std::string& cc, const std::vector<std::string>& flags,
+                    const std::string& file, Sample* sample, const std::string& log = "") {
+  std::vector<std::string> args = {cc, "-O2", "-c", file, "-o", "/dev/null"};
+  args.insert(args.end(), flags.begin(), flags.end());
+
+  std::vector<char*> argv;
+  for (auto& arg : args) argv.push_back((char*) arg.c_str());
+  argv.push_back(nullptr);
+
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid < 0) return false;
+  if (pid == 0) {
+    if (!log.empty()) freopen(log.c_str(), "w", stderr);
+    execvp(argv[0], argv.data());
+    _exit(127);
+  }
+
+  int status;
+  struct rusage usage{};
+  if (wait4(pid, &status, 0, &usage) != pid) return false;
+  auto end = std::chrono::steady_clock::now();
+
+  sample->seconds = std::chrono::duration<double>(end - start).count();
+  sample->rssMB = usage.ru_maxrss / 1024.0;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Sum the wall time -ftime-report gives dominator computation and loop
+ * discovery, the analyses the passes after the plugin redo if it drops them.
+ *
+ * @param log stderr of a compiler run with -ftime-report
+ * @return seconds, 0 if there is no report
+ */
+static double analysis_seconds(const std::string& log) {
+  static const char* timers[] = {"dominance computation", "loop init"};
+
+  std::ifstream in(log);
+  std::string line;
+  double seconds = 0;
+  while (std::getline(in, line)) {
+    size_t start = line.find_first_not_of(' ');
+    size_t colon = line.find(':');
+    if (start == std::string::npos || colon == std::string::npos) continue;
+
+    std::string name = line.substr(start, line.find_last_not_of(' ', colon - 1) + 1 - start);
+    for (const char* timer : timers) {
+      // e.g.: " dominance computation :   0.01 (  1%)   0.00 (  0%)   0.02 (  1%) ..."
+      double user, sys, wall;
+      if (name == timer && sscanf(line.c_str() + colon + 1, " %lf ( %*d%%) %lf ( %*d%%) %lf",
+                                  &user, &sys, &wall) == 3) {
+        seconds += wall;
+      }
+    }
+  }
+
+  return seconds;
+}
+
+/**
+ * The GC heap -fmem-report gives at the end of the compilation, where GCC
+ * keeps most of the IL: the Allocated column of its "Total" line.
+ *
+ * @param log stderr of a compiler run with -fmem-report
+ * @return megabytes, 0 if there is no report
+ */
+static double ggc_megabytes(const std::string& log) {
+  std::ifstream in(log);
+  std::string line;
+  bool table = false;
+  while (std::getline(in, line)) {
+    if (line.find("Memory still allocated at the end of the compilation") == 0) table = true;
+    if (!table || line.compare(0, 5, "Total") != 0) continue;
+
+    // e.g.: "Total          1584k       1481k         22k"
+    char* unit;
+    double size = strtod(line.c_str() + 5, &unit);
+    switch (*unit) {
+    case 'k':
+      return size / 1024;
+    case 'M':
+      return size;
+    case 'G':
+      return size * 1024;
+    default:
+      return size / (1024 * 1024);
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Least squares slope of log(y) over log(x), i.e.: the exponent k of y ~ x^k.
+ */
+static double slope(const std::vector<double>& x, const std::vector<double>& y) {
+  double n = x.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (size_t i = 0; i < x.size(); i++) {
+    double lx = std::log(x[i]), ly = std::log(y[i]);
+    sx += lx;
+    sy += ly;
+    sxx += lx * lx;
+    sxy += lx * ly;
+  }
+
+  double d = n * sxx - sx * sx;
+  return d == 0 ? 0 : (n * sxy - sx * sy) / d;
+}
+
+static void usage(const char* name) {
+  std::cerr << "usage: " << name << " --plugin <hellscape.so> [--cc <gcc>] [--dir <dir>]\n"
+            << "       [--steps <n>] [--sub-loop <n>] [--repeat <n>] [--threshold <k>]\n"
+            << "       [--blocks <n>] [--max-seconds <s>] [--json <file>]\n";
+}
+
+/**
+ * Generates C files of every shape at base * 2^i sizes, compiles them without
+ * the plugin and with fla, bcf and sub (at every subLoop up to --sub-loop),
+ * and fits how the time and memory the plugin adds grow with the size. Fails
+ * if any grows faster than size^threshold, once it is large enough to measure.
+ *
+ * Then compiles a single function of --blocks basic blocks without the plugin
+ * and with fla, recording the wall time, the peak RSS and the GC heap of
+ * -fmem-report, and fails if fla adds more than --max-seconds.
+ */
+int main(int argc, char** argv) {
+  std::string cc = "gcc";
+  std::string plugin;
+  std::string dir = "scale";
+  std::string jsonPath = "scale.json";
+  uint32_t steps = 4;
+  uint32_t subLoop = 3;
+  uint32_t repeat = 3;
+  double threshold = 1.25;
+  uint32_t blocks = 100000;
+  double maxSeconds = 60;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+
+    std::string value = argv[++i];
+    if (arg == "--cc") {
+      cc = value;
+    } else if (arg == "--plugin") {
+      plugin = value;
+    } else if (arg == "--dir") {
+      dir = value;
+    } else if (arg == "--json") {
+      jsonPath = value;
+    } else if (arg == "--steps") {
+      steps = strtoul(value.c_str(), nullptr, 10);
+    } else if (arg == "--sub-loop") {
+      subLoop = strtoul(value.c_str(), nullptr, 10);
+    } else if (arg == "--repeat") {
+      repeat = strtoul(value.c_str(), nullptr, 10);
+    } else if (arg == "--threshold") {
+      threshold = strtod(value.c_str(), nullptr);
+    } else if (arg == "--blocks") {
+      blocks = strtoul(value.c_str(), nullptr, 10);
+    } else if (arg == "--max-seconds") {
+      maxSeconds = strtod(value.c_str(), nullptr);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (plugin.empty() || steps < 2 || repeat == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  mkdir(dir.c_str(), 0755);
+
+  std::string load = "-fplugin=" + plugin;
+  std::vector<Config> configs = {
+    {"baseline", {}},
+    {"fla", {load, "-fplugin-arg-hellscape-fla"}},
+    {"bcf", {load, "-fplugin-arg-hellscape-bcf"}},
+  };
+  for (uint32_t loop = 1; loop <= subLoop; loop++) {
+    configs.push_back({"sub" + std::to_string(loop),
+                       {load, "-fplugin-arg-hellscape-sub",
+                        "-fplugin-arg-hellscape-subLoop=" + std::to_string(loop)}});
+  }
+
+  bool ok = true;
+  std::ostringstream json;
+  json << "{\"threshold\":" << threshold << ",\"results\":[";
+  bool first = true;
+
+  std::cout << std::left << std::setw(16) << "shape" << std::setw(10) << "config" << std::right;
+  for (uint32_t step = 0; step < steps; step++) {
+    std::cout << std::setw(12) << ("x" + std::to_string(1u << step));
+  }
+  std::cout << std::setw(10) << "time^k" << std::setw(10) << "rss^k" << std::setw(12)
+            << "dom+loop" << "\n";
+
+  for (const Shape& shape : shapes) {
+    std::vector<std::string> files;
+    std::vector<double> sizes;
+    for (uint32_t step = 0; step < steps; step++) {
+      uint32_t size = shape.base << step;
+      std::string file = dir + "/" + shape.name + "-" + std::to_string(size) + ".c";
+      std::ofstream out(file);
+      shape.generate(out, size);
+      files.push_back(file);
+      sizes.push_back(size);
+    }
+
+    std::vector<Sample> baseline;
+    for (const Config& config : configs) {
+      std::vector<Sample> samples;
+      for (uint32_t step = 0; step < steps; step++) {
+        // Best of --repeat runs.
+        Sample best{(uint32_t) sizes[step], 0, 0};
+        for (uint32_t run = 0; run < repeat; run++) {
+          Sample sample{(uint32_t) sizes[step], 0, 0};
+          if (!compile(cc, config.flags, files[step], &sample)) {
+            std::cerr << "error: " << config.name << " failed to compile " << files[step] << "\n";
+            return 1;
+          }
+
+          if (run == 0 || sample.seconds < best.seconds) best.seconds = sample.seconds;
+          if (run == 0 || sample.rssMB < best.rssMB) best.rssMB = sample.rssMB;
+        }
+        samples.push_back(best);
+      }
+
+      if (config.name == "baseline") baseline = samples;
+
+      // Once more at the largest size for the time GCC spends redoing the
+      // dominators and the loop tree, in the plugin's passes and after them.
+      std::string log = dir + "/" + shape.name + "-" + config.name + ".time-report";
+      std::vector<std::string> flags = config.flags;
+      flags.push_back("-ftime-report");
+      Sample reported{};
+      double analysis = 0;
+      if (compile(cc, flags, files.back(), &reported, log)) analysis = analysis_seconds(log);
+
+      // What the plugin adds on top of the compiler, with a floor against noise.
+      std::vector<double> time, rss;
+      for (uint32_t step = 0; step < steps; step++) {
+        bool base = config.name == "baseline";
+        time.push_back(std::max(samples[step].seconds - (base ? 0 : baseline[step].seconds), 1e-3));
+        rss.push_back(std::max(samples[step].rssMB - (base ? 0 : baseline[step].rssMB), 1.0));
+      }
+
+      // Only growth the plugin adds in a measurable amount counts, small
+      // differences to the baseline are noise and give arbitrary slopes.
+      bool timeMatters = config.name != "baseline" &&
+                         time.back() > std::max(0.05, 0.1 * baseline.back().seconds);
+      bool rssMatters = config.name != "baseline" &&
+                        rss.back() > std::max(8.0, 0.1 * baseline.back().rssMB);
+
+      double timeSlope = slope(sizes, time);
+      double rssSlope = slope(sizes, rss);
+      bool superlinear = (timeMatters && timeSlope > threshold) ||
+                         (rssMatters && rssSlope > threshold);
+      if (superlinear) ok = false;
+
+      std::cout << std::left << std::setw(16) << shape.name << std::setw(10) << config.name
+                << std::right << std::fixed;
+      for (const Sample& sample : samples) {
+        std::ostringstream cell;
+        cell << std::fixed << std::setprecision(2) << sample.seconds << "s";
+        std::cout << std::setw(12) << cell.str();
+      }
+      std::ostringstream analysisCell;
+      analysisCell << std::fixed << std::setprecision(2) << analysis << "s";
+      std::cout << std::setprecision(2) << std::setw(10) << timeSlope << std::setw(10) << rssSlope
+                << std::setw(12) << analysisCell.str() << (superlinear ? "  SUPERLINEAR" : "")
+                << "\n";
+
+      json << (first ? "" : ",") << "\n{\"shape\":\"" << shape.name << "\",\"config\":\""
+           << config.name << "\",\"time_slope\":" << timeSlope << ",\"rss_slope\":" << rssSlope
+           << ",\"superlinear\":" << (superlinear ? "true" : "false") << ",\"analysis_seconds\":"
+           << analysis << ",\"samples\":[";
+      for (size_t i = 0; i < samples.size(); i++) {
+        json << (i ? "," : "") << "{\"size\":" << samples[i].size << ",\"seconds\":"
+             << samples[i].seconds << ",\"rss_mb\":" << samples[i].rssMB << "}";
+      }
+      json << "]}";
+      first = false;
+    }
+  }
+
+  json << "\n]";
+
+  // The size of the generated parsers and state machines which used to keep
+  // FLA busy for minutes, 0 skips it.
+  if (blocks > 0) {
+    std::string file = dir + "/blocks-" + std::to_string(blocks) + ".c";
+    {
+      std::ofstream out(file);
+      huge_function(out, blocks / HUGE_BLOCKS_PER_STMT);
+    }
+
+    json << ",\"blocks\":{\"size\":" << blocks << ",\"max_seconds\":" << maxSeconds
+         << ",\"results\":[";
+
+    Sample baseline{};
+    for (size_t i = 0; i < 2; i++) {
+      const Config& config = configs[i];
+      std::string log = dir + "/blocks-" + config.name + ".mem-report";
+      std::vector<std::string> flags = config.flags;
+      flags.push_back("-fmem-report");
+
+      Sample sample{blocks, 0, 0};
+      if (!compile(cc, flags, file, &sample, log)) {
+        std::cerr << "error: " << config.name << " failed to compile " << file << "\n";
+        return 1;
+      }
+      if (i == 0) baseline = sample;
+
+      double ggc = ggc_megabytes(log);
+      double added = sample.seconds - baseline.seconds;
+      bool slow = i > 0 && added > maxSeconds;
+      if (slow) ok = false;
+
+      std::cout << std::left << std::setw(16) << ("blocks-" + std::to_string(blocks))
+                << std::setw(10) << config.name << std::right << std::fixed << std::setprecision(2)
+                << std::setw(10) << sample.seconds << "s" << std::setw(10) << sample.rssMB
+                << " MB rss" << std::setw(10) << ggc << " MB ggc"
+                << (slow ? "  TOO SLOW" : "") << "\n";
+
+      json << (i ? "," : "") << "\n{\"config\":\"" << config.name << "\",\"seconds\":"
+           << sample.seconds << ",\"rss_mb\":" << sample.rssMB << ",\"ggc_mb\":" << ggc
+           << ",\"too_slow\":" << (slow ? "true" : "false") << "}";
+    }
+
+    json << "\n]}";
+  }
+
+  json << "}\n";
+  std::ofstream(jsonPath) << json.str();
+
+  return ok ? 0 : 1;
+}
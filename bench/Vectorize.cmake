@@ -0,0 +1,53 @@
+# Compiles the SIMD kernels of hellscape-check-vec without and with
+# substitution in subVec mode and fails if a loop stops vectorizing, e.g.:
+#   cmake -DCC=gcc -DPLUGIN=hellscape.so -DSOURCE=vec_kernels.c -P Vectorize.cmake
+
+foreach(var CC PLUGIN SOURCE)
+  if(NOT DEFINED ${var})
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+
+# Sets out to the lines of the loops -fopt-info-vec reports vectorized.
+function(vectorized_loops out)
+  execute_process(COMMAND ${CC} -O3 -fopt-info-vec-optimized ${ARGN} -c ${SOURCE} -o /dev/null
+                  ERROR_VARIABLE report RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${CC} ${ARGN} failed:\n${report}")
+  endif()
+
+  # e.g.: vec_kernels.c:25:24: optimized: loop vectorized using 16 byte vectors
+  string(REGEX MATCHALL ":[0-9]+:[0-9]+: [^\n]*loop vectorized" matches "${report}")
+  set(lines)
+  foreach(match ${matches})
+    string(REGEX MATCH "^:[0-9]+" line "${match}")
+    string(SUBSTRING "${line}" 1 -1 line)
+    list(APPEND lines ${line})
+  endforeach()
+  list(REMOVE_DUPLICATES lines)
+  set(${out} ${lines} PARENT_SCOPE)
+endfunction()
+
+vectorized_loops(baseline)
+if(NOT baseline)
+  message(FATAL_ERROR "${CC} vectorizes none of the kernels without the plugin")
+endif()
+
+vectorized_loops(substituted -fplugin=${PLUGIN} -fplugin-arg-hellscape-seed=deadbeef
+                 -fplugin-arg-hellscape-sub -fplugin-arg-hellscape-subVec)
+
+set(lost)
+foreach(line ${baseline})
+  list(FIND substituted ${line} found)
+  if(found EQUAL -1)
+    list(APPEND lost ${line})
+  endif()
+endforeach()
+
+list(LENGTH baseline total)
+list(LENGTH lost count)
+message(STATUS "${total} loops vectorized without the plugin, ${count} lost under sub")
+if(lost)
+  string(REPLACE ";" ", " lost "${lost}")
+  message(FATAL_ERROR "loops at lines ${lost} of ${SOURCE} no longer vectorize under sub")
+endif()
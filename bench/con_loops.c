@@ -0,0 +1,49 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+uint32_t con_loops_plain(const uint8_t* data, size_t size);
+uint32_t con_loops_encoded(const uint8_t* data, size_t size);
+
+/**
+ * Compares the encoded constant kernel with the plain one on inputs of every
+ * length up to sizeof(data), fails on the first difference.
+ */
+int main(void) {
+  uint8_t data[512];
+  uint32_t x = 1;
+  for (size_t i = 0; i < sizeof(data); i++) {
+    x = x * 1103515245u + 12345u;
+    data[i] = (uint8_t) (x >> 16);
+  }
+  data[17] = 0x2a;
+
+  for (size_t size = 0; size <= sizeof(data); size++) {
+    uint32_t plain = con_loops_plain(data, size);
+    uint32_t encoded = con_loops_encoded(data, size);
+    if (plain != encoded) {
+      fprintf(stderr, "error: %zu bytes: %08x encoded, %08x plain\n", size, encoded, plain);
+      return 1;
+    }
+  }
+
+  printf("con loops: ok\n");
+  return 0;
+}
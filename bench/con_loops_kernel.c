@@ -0,0 +1,57 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Built twice by hellscape-check-con, plain and encoded, under two names.
+#ifndef CON_LOOPS
+#define CON_LOOPS con_loops
+#endif
+
+/**
+ * Constants in the bodies of nested loops and of a loop with several latches
+ * (every continue is a back edge of its own until the loop optimizer merges
+ * them), which is what the cfg pass leaves the early placement with.
+ */
+uint32_t CON_LOOPS(const uint8_t* data, size_t size) {
+  uint32_t h = 0x811c9dc5u;
+
+  for (size_t i = 0; i < size; i++) {
+    if (data[i] == 0x2a) {
+      h ^= 0x5bd1e995u;
+      continue;
+    }
+
+    for (int j = 0; j < 3; j++) {
+      h = (h + 0x9e3779b9u) ^ (data[i] | 0x100u);
+      if ((h & 0x40) == 0) continue;
+      h -= 0x7f4a7c15u;
+    }
+
+    if (h > 0xc0000000u) continue;
+    h += 0x1234u;
+  }
+
+  size_t n = size;
+  while (n > 7) {
+    n -= 7;
+    h ^= (uint32_t) n + 0x3c6ef372u;
+  }
+
+  return h;
+}
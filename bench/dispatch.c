@@ -0,0 +1,127 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "dispatch.h"
+
+// Best of RUNS, to keep frequency ramp up and interrupts out of the result.
+#define RUNS 5
+
+static uint64_t nanoseconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Reference (TSC) cycles, 0 where there is no cycle counter.
+static uint64_t cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Open a counter of the mispredicted branches of this thread, user space only.
+ *
+ * @return its file descriptor, -1 if perf_event_paranoid or the PMU don't allow it
+ */
+static int open_branch_misses(void) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * Usage: dispatch <mode> [iterations]
+ *
+ * Prints the time, cycles and branch misses per original CFG transition of
+ * dispatch_kernel, compiled in the given dispatch mode.
+ */
+int main(int argc, char** argv) {
+  const char* mode = argc > 1 ? argv[1] : "dispatch";
+  uint32_t iterations = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000;
+  if (iterations == 0) {
+    fprintf(stderr, "error: iterations argument malformed\n");
+    return 1;
+  }
+
+  int misses_fd = open_branch_misses();
+
+  uint64_t best_ns = UINT64_MAX;
+  uint64_t best_cycles = UINT64_MAX;
+  uint64_t best_misses = UINT64_MAX;
+  uint32_t checksum = 0;
+
+  for (int run = 0; run < RUNS; run++) {
+    if (misses_fd >= 0) {
+      ioctl(misses_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(misses_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    uint64_t start_ns = nanoseconds();
+    uint64_t start_cycles = cycles();
+    checksum = dispatch_kernel(iterations, 0xdeadbeef);
+    uint64_t elapsed_cycles = cycles() - start_cycles;
+    uint64_t elapsed_ns = nanoseconds() - start_ns;
+
+    uint64_t misses;
+    if (misses_fd >= 0) {
+      ioctl(misses_fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(misses_fd, &misses, sizeof(misses)) == sizeof(misses) && misses < best_misses) {
+        best_misses = misses;
+      }
+    }
+
+    if (elapsed_ns < best_ns) best_ns = elapsed_ns;
+    if (elapsed_cycles < best_cycles) best_cycles = elapsed_cycles;
+  }
+
+  double transitions = (double) iterations * DISPATCH_TRANSITIONS;
+  printf("%-10s %8.3f ns/transition %8.2f cycles/transition ", mode, best_ns / transitions,
+         best_cycles / transitions);
+  if (best_misses == UINT64_MAX) {
+    printf("%8s branch misses/transition", "-");
+  } else {
+    printf("%8.3f branch misses/transition", best_misses / transitions);
+  }
+  printf(" (checksum %08x)\n", checksum);
+  return 0;
+}
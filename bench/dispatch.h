@@ -0,0 +1,38 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Steps in dispatch_kernel.
+#define DISPATCH_STEPS 16
+
+// Edges of the original CFG taken per iteration of dispatch_kernel, each one
+// goes through the switch once flattened: two per step, the latch to the loop
+// test and the test back into the body.
+#define DISPATCH_TRANSITIONS (2 * DISPATCH_STEPS + 2)
+
+/**
+ * State machine with DISPATCH_TRANSITIONS unpredictable transitions per
+ * iteration, compiled with the plugin.
+ *
+ * @param iterations iterations to run
+ * @param x seed
+ * @return checksum, the same for every dispatch mode
+ */
+uint32_t dispatch_kernel(uint32_t iterations, uint32_t x);
@@ -0,0 +1,42 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+#include "dispatch.h"
+
+// One data dependent branch per step: the test, then one of the two arms, which
+// falls through into the next test.
+#define STEP(n)                  \
+  if (x & (1u << (n))) {         \
+    acc += x >> (n);             \
+  } else {                       \
+    acc ^= x << (n);             \
+  }
+
+uint32_t dispatch_kernel(uint32_t iterations, uint32_t x) {
+  uint32_t acc = 0;
+
+  for (uint32_t i = 0; i < iterations; i++) {
+    x = x * 1664525u + 1013904223u;
+
+    STEP(0) STEP(1) STEP(2) STEP(3) STEP(4) STEP(5) STEP(6) STEP(7)
+    STEP(8) STEP(9) STEP(10) STEP(11) STEP(12) STEP(13) STEP(14) STEP(15)
+  }
+
+  return acc;
+}
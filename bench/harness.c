@@ -0,0 +1,177 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "kernels.h"
+
+// Best of RUNS, each running the kernel reps times.
+#define RUNS 5
+
+struct kernel {
+  const char* name;
+  void (*setup)(void);
+  uint64_t (*run)(void);
+  uint32_t reps;
+};
+
+static const struct kernel kernels[] = {
+  {"crc32", crc32_setup, crc32_run, 200},
+  {"sha256", sha256_setup, sha256_run, 200},
+  {"quicksort", quicksort_setup, quicksort_run, 20},
+  {"hash_probe", hash_probe_setup, hash_probe_run, 50},
+  {"json", json_setup, json_run, 100},
+  {"matmul", matmul_setup, matmul_run, 10},
+  {"logging", logging_setup, logging_run, 100},
+};
+
+struct counter {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+  int fd;
+};
+
+#define CACHE_MISS(cache) \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static struct counter counters[] = {
+  {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1},
+  {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1},
+  {"itlb_misses", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_ITLB), -1},
+  {"icache_misses", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1I), -1},
+};
+
+#define COUNTERS (sizeof(counters) / sizeof(counters[0]))
+
+/**
+ * Open the counters for this thread, user space only. A counter the kernel or
+ * the PMU doesn't offer (e.g.: perf_event_paranoid, VMs) stays closed and is
+ * reported as null.
+ */
+static void open_counters(void) {
+  for (size_t i = 0; i < COUNTERS; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counters[i].type;
+    attr.config = counters[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // The PMU may have to multiplex, scale by the time each counter ran.
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    counters[i].fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+}
+
+static void start_counters(void) {
+  for (size_t i = 0; i < COUNTERS; i++) {
+    if (counters[i].fd < 0) continue;
+
+    ioctl(counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+static void stop_counters(int64_t values[COUNTERS]) {
+  for (size_t i = 0; i < COUNTERS; i++) {
+    values[i] = -1;
+    if (counters[i].fd < 0) continue;
+
+    ioctl(counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+
+    uint64_t data[3];
+    if (read(counters[i].fd, data, sizeof(data)) != sizeof(data) || data[2] == 0) continue;
+
+    values[i] = (int64_t) ((double) data[0] * data[1] / data[2]);
+  }
+}
+
+static uint64_t nanoseconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * Usage: harness [kernel]
+ *
+ * Runs every kernel (or the given one) and prints a JSON line per kernel with
+ * the best time and the counters of that run, for hellscape-bench-runner.
+ */
+int main(int argc, char** argv) {
+  const char* only = argc > 1 ? argv[1] : NULL;
+
+  open_counters();
+
+  for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+    const struct kernel* kernel = &kernels[k];
+    if (only && strcmp(only, kernel->name) != 0) continue;
+
+    kernel->setup();
+    // Warm up the caches, the branch predictors and the CPU frequency.
+    uint64_t checksum = kernel->run();
+
+    uint64_t best_ns = UINT64_MAX;
+    int64_t best_values[COUNTERS];
+    for (int run = 0; run < RUNS; run++) {
+      int64_t values[COUNTERS];
+
+      start_counters();
+      uint64_t start = nanoseconds();
+      for (uint32_t rep = 0; rep < kernel->reps; rep++) {
+        if (kernel->run() != checksum) {
+          fprintf(stderr, "error: %s returned different checksums\n", kernel->name);
+          return 1;
+        }
+      }
+      uint64_t elapsed = nanoseconds() - start;
+      stop_counters(values);
+
+      if (elapsed < best_ns) {
+        best_ns = elapsed;
+        memcpy(best_values, values, sizeof(values));
+      }
+    }
+
+    printf("{\"kernel\":\"%s\",\"checksum\":\"%016llx\",\"ns\":%.1f", kernel->name,
+           (unsigned long long) checksum, (double) best_ns / kernel->reps);
+    for (size_t i = 0; i < COUNTERS; i++) {
+      if (best_values[i] < 0) {
+        printf(",\"%s\":null", counters[i].name);
+      } else {
+        printf(",\"%s\":%.1f", counters[i].name, (double) best_values[i] / kernel->reps);
+      }
+    }
+    printf("}\n");
+  }
+
+  return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Kernels of hellscape-bench, compiled with the plugin. setup builds the input
+// (untimed), run does the work once and returns a checksum which must not
+// depend on how the kernel was obfuscated.
+
+void crc32_setup(void);
+uint64_t crc32_run(void);
+
+void sha256_setup(void);
+uint64_t sha256_run(void);
+
+void quicksort_setup(void);
+uint64_t quicksort_run(void);
+
+void hash_probe_setup(void);
+uint64_t hash_probe_run(void);
+
+void json_setup(void);
+uint64_t json_run(void);
+
+void matmul_setup(void);
+uint64_t matmul_run(void);
+
+void logging_setup(void);
+uint64_t logging_run(void);
+
+/**
+ * Deterministic input generator shared by the kernels (xorshift32).
+ */
+static inline uint32_t bench_random(uint32_t* state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
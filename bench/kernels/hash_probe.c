@@ -0,0 +1,85 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "kernels.h"
+
+// Open addressing with linear probing, half full.
+#define CAPACITY 16384
+#define KEYS 8192
+#define LOOKUPS 65536
+
+static uint32_t keys[CAPACITY];
+static uint32_t values[CAPACITY];
+static uint32_t queries[LOOKUPS];
+
+static uint32_t hash(uint32_t key) {
+  key ^= key >> 16;
+  key *= 0x7feb352d;
+  key ^= key >> 15;
+  key *= 0x846ca68b;
+  key ^= key >> 16;
+  return key;
+}
+
+static void insert(uint32_t key, uint32_t value) {
+  for (uint32_t i = hash(key) & (CAPACITY - 1);; i = (i + 1) & (CAPACITY - 1)) {
+    if (keys[i] == 0 || keys[i] == key) {
+      keys[i] = key;
+      values[i] = value;
+      return;
+    }
+  }
+}
+
+static int lookup(uint32_t key, uint32_t* value) {
+  for (uint32_t i = hash(key) & (CAPACITY - 1);; i = (i + 1) & (CAPACITY - 1)) {
+    if (keys[i] == key) {
+      *value = values[i];
+      return 1;
+    }
+    if (keys[i] == 0) return 0;
+  }
+}
+
+void hash_probe_setup(void) {
+  uint32_t state = 0xc0ffee;
+  for (size_t i = 0; i < LOOKUPS; i++) {
+    // Every other query misses, 0 marks an empty slot.
+    queries[i] = (bench_random(&state) % (2 * KEYS)) + 1;
+  }
+}
+
+uint64_t hash_probe_run(void) {
+  memset(keys, 0, sizeof(keys));
+  for (uint32_t key = 1; key <= KEYS; key++) {
+    insert(key, key * 2654435761u);
+  }
+
+  uint64_t sum = 0;
+  for (size_t i = 0; i < LOOKUPS; i++) {
+    uint32_t value;
+    if (lookup(queries[i], &value)) {
+      sum += value;
+    } else {
+      sum ^= queries[i];
+    }
+  }
+  return sum;
+}
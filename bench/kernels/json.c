@@ -0,0 +1,114 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "kernels.h"
+
+#define SIZE (64 * 1024)
+
+static char text[SIZE];
+
+enum token {
+  TOKEN_ERROR,
+  TOKEN_END,
+  TOKEN_PUNCTUATION,
+  TOKEN_STRING,
+  TOKEN_NUMBER,
+  TOKEN_LITERAL,
+};
+
+/**
+ * Scan one token starting at *p, advancing *p past it.
+ */
+static enum token next_token(const char** p) {
+  const char* c = *p;
+  while (*c == ' ' || *c == '\n' || *c == '\t' || *c == '\r') c++;
+
+  enum token token;
+  switch (*c) {
+  case 0:
+    token = TOKEN_END;
+    break;
+  case '{': case '}': case '[': case ']': case ':': case ',':
+    c++;
+    token = TOKEN_PUNCTUATION;
+    break;
+  case '"':
+    c++;
+    while (*c && *c != '"') {
+      if (*c == '\\' && c[1]) c++;
+      c++;
+    }
+    if (!*c) return TOKEN_ERROR;
+    c++;
+    token = TOKEN_STRING;
+    break;
+  case '-': case '0': case '1': case '2': case '3': case '4':
+  case '5': case '6': case '7': case '8': case '9':
+    c++;
+    while ((*c >= '0' && *c <= '9') || *c == '.' || *c == 'e' || *c == 'E' ||
+           *c == '+' || *c == '-') {
+      c++;
+    }
+    token = TOKEN_NUMBER;
+    break;
+  case 't': case 'f': case 'n':
+    while (*c >= 'a' && *c <= 'z') c++;
+    token = TOKEN_LITERAL;
+    break;
+  default:
+    return TOKEN_ERROR;
+  }
+
+  *p = c;
+  return token;
+}
+
+void json_setup(void) {
+  static const char* names[] = {"id", "name", "tags", "enabled", "ratio", "escaped\\\"key"};
+
+  uint32_t state = 0xfeedface;
+  size_t n = 0;
+  n += snprintf(text + n, SIZE - n, "[");
+  while (n < SIZE - 256) {
+    uint32_t r = bench_random(&state);
+    n += snprintf(text + n, SIZE - n, "{\"%s\": %u, \"%s\": \"item %u\", \"%s\": [%s, %s, null], \"%s\": -%u.%ue-3},\n",
+                  names[r % 6], r, names[(r >> 3) % 6], r >> 7, names[(r >> 5) % 6],
+                  r & 1 ? "true" : "false", r & 2 ? "true" : "false", names[(r >> 9) % 6],
+                  r % 1000, r % 97);
+  }
+  snprintf(text + n, SIZE - n, "{}]");
+}
+
+uint64_t json_run(void) {
+  uint64_t counts[TOKEN_LITERAL + 1] = {0};
+
+  const char* p = text;
+  for (;;) {
+    enum token token = next_token(&p);
+    counts[token]++;
+    if (token == TOKEN_END || token == TOKEN_ERROR) break;
+  }
+
+  uint64_t sum = 0;
+  for (int i = 0; i <= TOKEN_LITERAL; i++) {
+    sum = sum * 65599 + counts[i];
+  }
+  return sum;
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "kernels.h"
+
+#define EVENTS 4096
+
+// Formatting log lines uses a handful of literals over and over, the pattern
+// string encryption has to keep cheap.
+
+static uint32_t events[EVENTS];
+
+static const char* level_name(uint32_t level) {
+  switch (level) {
+  case 0: return "debug";
+  case 1: return "info";
+  case 2: return "warning";
+  default: return "error";
+  }
+}
+
+/**
+ * Format one event into line.
+ *
+ * @return the length of the line
+ */
+static int format_event(char* line, size_t size, uint32_t event) {
+  uint32_t level = event & 3;
+  switch ((event >> 2) & 3) {
+  case 0:
+    return snprintf(line, size, "[%s] connection %u accepted from %s\n", level_name(level),
+                    event >> 8, "10.0.0.1");
+  case 1:
+    return snprintf(line, size, "[%s] request %u took %u us\n", level_name(level),
+                    event >> 8, event & 0xff);
+  case 2:
+    return snprintf(line, size, "[%s] cache %s for key %u\n", level_name(level),
+                    event & 0x10 ? "hit" : "miss", event >> 8);
+  default:
+    return snprintf(line, size, "[%s] %s\n", level_name(level), "heartbeat");
+  }
+}
+
+void logging_setup(void) {
+  uint32_t state = 0x10c10c10;
+  for (int i = 0; i < EVENTS; i++) {
+    events[i] = bench_random(&state);
+  }
+}
+
+uint64_t logging_run(void) {
+  char line[128];
+
+  uint64_t sum = 0;
+  for (int i = 0; i < EVENTS; i++) {
+    int n = format_event(line, sizeof(line), events[i]);
+    // Only lines of a level that is enabled are "written".
+    if ((events[i] & 3) == 0 && strcmp(level_name(0), "debug") == 0) continue;
+
+    for (int j = 0; j < n; j++) {
+      sum = sum * 31 + (unsigned char) line[j];
+    }
+  }
+  return sum;
+}
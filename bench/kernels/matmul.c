@@ -0,0 +1,56 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+
+#include "kernels.h"
+
+#define N 96
+
+static uint32_t a[N][N];
+static uint32_t b[N][N];
+static uint32_t c[N][N];
+
+void matmul_setup(void) {
+  uint32_t state = 0xabcdef01;
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      a[i][j] = bench_random(&state) & 0xffff;
+      b[i][j] = bench_random(&state) & 0xffff;
+    }
+  }
+}
+
+uint64_t matmul_run(void) {
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      c[i][j] = 0;
+    }
+    for (size_t k = 0; k < N; k++) {
+      uint32_t aik = a[i][k];
+      for (size_t j = 0; j < N; j++) {
+        c[i][j] += aik * b[k][j];
+      }
+    }
+  }
+
+  uint64_t sum = 0;
+  for (size_t i = 0; i < N; i++) {
+    sum += c[i][(i * 7) % N] ^ c[(i * 13) % N][i];
+  }
+  return sum;
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+
+#include "kernels.h"
+
+#define SIZE 16384
+
+static uint32_t input[SIZE];
+static uint32_t work[SIZE];
+
+static void insertion_sort(uint32_t* a, ptrdiff_t n) {
+  for (ptrdiff_t i = 1; i < n; i++) {
+    uint32_t v = a[i];
+    ptrdiff_t j = i - 1;
+    while (j >= 0 && a[j] > v) {
+      a[j + 1] = a[j];
+      j--;
+    }
+    a[j + 1] = v;
+  }
+}
+
+static void quicksort(uint32_t* a, ptrdiff_t n) {
+  while (n > 16) {
+    // Median of three.
+    uint32_t x = a[0], y = a[n / 2], z = a[n - 1];
+    uint32_t pivot = x < y ? (y < z ? y : (x < z ? z : x)) : (x < z ? x : (y < z ? z : y));
+
+    ptrdiff_t i = -1, j = n;
+    for (;;) {
+      do i++; while (a[i] < pivot);
+      do j--; while (a[j] > pivot);
+      if (i >= j) break;
+
+      uint32_t t = a[i];
+      a[i] = a[j];
+      a[j] = t;
+    }
+
+    // Recurse into the smaller half.
+    if (j + 1 < n - j - 1) {
+      quicksort(a, j + 1);
+      a += j + 1;
+      n -= j + 1;
+    } else {
+      quicksort(a + j + 1, n - j - 1);
+      n = j + 1;
+    }
+  }
+
+  insertion_sort(a, n);
+}
+
+void quicksort_setup(void) {
+  uint32_t state = 0xdeadbeef;
+  for (size_t i = 0; i < SIZE; i++) {
+    input[i] = bench_random(&state);
+  }
+}
+
+uint64_t quicksort_run(void) {
+  for (size_t i = 0; i < SIZE; i++) {
+    work[i] = input[i];
+  }
+
+  quicksort(work, SIZE);
+
+  uint64_t sum = 0;
+  for (size_t i = 0; i < SIZE; i++) {
+    sum = sum * 31 + work[i];
+  }
+  return sum;
+}
@@ -0,0 +1,35 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Built once per function of the shared objects of hellscape-check-relocs,
+// each time under another name.
+#ifndef RELOCS_FUNCTION
+#define RELOCS_FUNCTION relocs
+#endif
+
+int RELOCS_FUNCTION(const int* a, int n) {
+  int s = 0;
+  for (int i = 0; i < n; i++) {
+    if (a[i] > s) {
+      s += a[i];
+    } else {
+      s ^= a[i] << 1;
+    }
+  }
+
+  return s;
+}
@@ -0,0 +1,77 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "rules.h"
+
+// Best of RUNS, to keep frequency ramp up and interrupts out of the result.
+#define RUNS 5
+
+struct chain {
+  const char* function;
+  uint64_t (*run)(uint64_t, uint64_t, uint64_t);
+};
+
+static const struct chain chains[] = {
+  {"rules_and", rules_and},
+  {"rules_or", rules_or},
+  {"rules_xor", rules_xor},
+  {"rules_add", rules_add},
+  {"rules_sub", rules_sub},
+  {"rules_neg", rules_neg},
+};
+
+static uint64_t nanoseconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * Usage: rules [iterations]
+ *
+ * Prints a JSON line per chain with the time per operation and the result,
+ * for hellscape-bench-rules.
+ */
+int main(int argc, char** argv) {
+  uint64_t iterations = argc > 1 ? strtoull(argv[1], NULL, 10) : 2000000;
+  if (iterations == 0) {
+    fprintf(stderr, "error: iterations argument malformed\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < sizeof(chains) / sizeof(chains[0]); i++) {
+    uint64_t best_ns = UINT64_MAX;
+    uint64_t result = 0;
+
+    for (int run = 0; run < RUNS; run++) {
+      uint64_t start = nanoseconds();
+      result = chains[i].run(iterations, 0x0123456789abcdefu, 0x5555aaaa3333ccccu);
+      uint64_t elapsed = nanoseconds() - start;
+      if (elapsed < best_ns) best_ns = elapsed;
+    }
+
+    printf("{\"function\":\"%s\",\"ns\":%.4f,\"result\":\"%016llx\"}\n", chains[i].function,
+           (double) best_ns / ((double) iterations * RULES_CHAIN), (unsigned long long) result);
+  }
+
+  return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Operations in rules_* per iteration.
+#define RULES_CHAIN 8
+
+// Chains of one operation each, compiled with one substitution rule forced by
+// hellscape-bench-rules. Return the last value, the same for every rule.
+
+uint64_t rules_and(uint64_t iterations, uint64_t x, uint64_t c);
+uint64_t rules_or(uint64_t iterations, uint64_t x, uint64_t c);
+uint64_t rules_xor(uint64_t iterations, uint64_t x, uint64_t c);
+uint64_t rules_add(uint64_t iterations, uint64_t x, uint64_t c);
+uint64_t rules_sub(uint64_t iterations, uint64_t x, uint64_t c);
+uint64_t rules_neg(uint64_t iterations, uint64_t x, uint64_t c);
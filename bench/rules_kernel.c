@@ -0,0 +1,68 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rules.h"
+
+// A chain of dependent operations, 8 per iteration. The empty asm between them
+// keeps GCC from merging neighbours (e.g.: x & c & c) without costing an
+// instruction, so the chain takes the latency of the operation, as the build
+// forcing a rule rewrites it.
+#define CHAIN(expr) x = (expr); __asm__("" : "+r"(x));
+#define CHAIN8(expr) CHAIN(expr) CHAIN(expr) CHAIN(expr) CHAIN(expr) \
+                     CHAIN(expr) CHAIN(expr) CHAIN(expr) CHAIN(expr)
+
+uint64_t rules_and(uint64_t iterations, uint64_t x, uint64_t c) {
+  for (uint64_t i = 0; i < iterations; i++) {
+    CHAIN8(x & c)
+  }
+  return x;
+}
+
+uint64_t rules_or(uint64_t iterations, uint64_t x, uint64_t c) {
+  for (uint64_t i = 0; i < iterations; i++) {
+    CHAIN8(x | c)
+  }
+  return x;
+}
+
+uint64_t rules_xor(uint64_t iterations, uint64_t x, uint64_t c) {
+  for (uint64_t i = 0; i < iterations; i++) {
+    CHAIN8(x ^ c)
+  }
+  return x;
+}
+
+uint64_t rules_add(uint64_t iterations, uint64_t x, uint64_t c) {
+  for (uint64_t i = 0; i < iterations; i++) {
+    CHAIN8(x + c)
+  }
+  return x;
+}
+
+uint64_t rules_sub(uint64_t iterations, uint64_t x, uint64_t c) {
+  for (uint64_t i = 0; i < iterations; i++) {
+    CHAIN8(x - c)
+  }
+  return x;
+}
+
+uint64_t rules_neg(uint64_t iterations, uint64_t x, uint64_t c) {
+  for (uint64_t i = 0; i < iterations; i++) {
+    CHAIN8(-x)
+  }
+  return x ^ c;
+}
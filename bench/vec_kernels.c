@@ -0,0 +1,55 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SIMD-friendly loops of hellscape-check-vec, each must still be vectorized
+// under -fplugin-arg-hellscape-sub with subVec.
+
+void vec_xor_cipher(uint8_t* out, const uint8_t* in, const uint8_t* key, size_t n) {
+  for (size_t i = 0; i < n; i++) out[i] = in[i] ^ key[i];
+}
+
+void vec_xor_stream(uint8_t* data, uint8_t key, size_t n) {
+  for (size_t i = 0; i < n; i++) data[i] = (data[i] ^ key) + 0x5b;
+}
+
+void vec_bitmap_and(uint64_t* out, const uint64_t* a, const uint64_t* b, size_t n) {
+  for (size_t i = 0; i < n; i++) out[i] = a[i] & b[i];
+}
+
+void vec_bitmap_or(uint64_t* out, const uint64_t* a, const uint64_t* b, size_t n) {
+  for (size_t i = 0; i < n; i++) out[i] = a[i] | b[i];
+}
+
+void vec_bitmap_andnot(uint32_t* out, const uint32_t* a, const uint32_t* b, size_t n) {
+  for (size_t i = 0; i < n; i++) out[i] = (a[i] & ~b[i]) | (a[i] & 0x0f0f0f0fu);
+}
+
+uint32_t vec_popcount(const uint32_t* a, size_t n) {
+  uint32_t count = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint32_t x = a[i];
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    x = (x + (x >> 4)) & 0x0f0f0f0fu;
+    count += (x * 0x01010101u) >> 24;
+  }
+
+  return count;
+}
@@ -0,0 +1,217 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hellscape_profile.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Slots are handed out in chunks, so the counters of a slot never move while
+// a function holds on to them.
+#define CHUNK 1024
+#define CHUNKS 1024
+
+struct function_info {
+  char* function;
+  char* tu;
+};
+
+struct thread_counters {
+  struct thread_counters* next;
+  uint64_t* chunks[CHUNKS];
+};
+
+static char lock;
+static uint32_t function_count;
+static struct function_info* functions[CHUNKS];
+
+// Every thread's counters, kept after the thread exits until the dump.
+static struct thread_counters* threads;
+
+static __thread struct thread_counters* current;
+// Where the counters go that can't be allocated.
+static __thread uint64_t discard[HELLSCAPE_PROFILE_COUNTERS];
+
+static void dump(void);
+
+static void acquire(void) {
+  while (__atomic_test_and_set(&lock, __ATOMIC_ACQUIRE)) {
+  }
+}
+
+static void release(void) {
+  __atomic_clear(&lock, __ATOMIC_RELEASE);
+}
+
+/**
+ * Give a function its slot, unless another thread just did.
+ *
+ * @return the slot, 0 if there are no more
+ */
+static uint32_t assign(uint32_t* slot, const char* function, const char* tu) {
+  acquire();
+
+  uint32_t index = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+  if (index == 0 && function_count < CHUNK * CHUNKS) {
+    uint32_t i = function_count;
+    if (!functions[i / CHUNK]) functions[i / CHUNK] = calloc(CHUNK, sizeof(struct function_info));
+
+    // Copied, the names of a module which is unloaded before exit are gone.
+    struct function_info* info = functions[i / CHUNK];
+    if (info) {
+      info[i % CHUNK].function = strdup(function);
+      info[i % CHUNK].tu = strdup(tu);
+      if (i == 0) atexit(dump);
+
+      index = ++function_count;
+      __atomic_store_n(slot, index, __ATOMIC_RELEASE);
+    }
+  }
+
+  release();
+  return index;
+}
+
+static struct thread_counters* attach_thread(void) {
+  struct thread_counters* thread = calloc(1, sizeof(struct thread_counters));
+  if (!thread) return NULL;
+
+  thread->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&threads, &thread->next, thread, 1, __ATOMIC_RELEASE,
+                                      __ATOMIC_RELAXED)) {
+  }
+
+  current = thread;
+  return thread;
+}
+
+uint64_t* __hellscape_profile_attach(uint32_t* slot, const char* function, const char* tu) {
+  uint32_t index = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+  if (__builtin_expect(index == 0, 0)) {
+    index = assign(slot, function, tu);
+    if (index == 0) return discard;
+  }
+
+  struct thread_counters* thread = current;
+  if (__builtin_expect(!thread, 0)) {
+    thread = attach_thread();
+    if (!thread) return discard;
+  }
+
+  uint32_t i = index - 1;
+  uint64_t* chunk = thread->chunks[i / CHUNK];
+  if (__builtin_expect(!chunk, 0)) {
+    chunk = calloc(CHUNK * HELLSCAPE_PROFILE_COUNTERS, sizeof(uint64_t));
+    if (!chunk) return discard;
+
+    // The dump may read it from another thread.
+    __atomic_store_n(&thread->chunks[i / CHUNK], chunk, __ATOMIC_RELEASE);
+  }
+
+  return chunk + (i % CHUNK) * HELLSCAPE_PROFILE_COUNTERS;
+}
+
+/**
+ * Print a JSON string.
+ */
+static void print_string(FILE* out, const char* s) {
+  fputc('"', out);
+  for (const char* c = s; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      fprintf(out, "\\%c", *c);
+    } else if ((unsigned char) *c < 0x20) {
+      fprintf(out, "\\u%04x", (unsigned) *c);
+    } else {
+      fputc(*c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+/**
+ * Sum the counters of all threads and append a line per function that counted
+ * anything, with a single write so processes can share the file.
+ */
+static void dump(void) {
+  char* buffer = NULL;
+  size_t size = 0;
+  FILE* out = open_memstream(&buffer, &size);
+  if (!out) return;
+
+  acquire();
+  uint32_t count = function_count;
+  release();
+
+  struct thread_counters* all = __atomic_load_n(&threads, __ATOMIC_ACQUIRE);
+  for (uint32_t i = 0; i < count; i++) {
+    uint64_t sum[HELLSCAPE_PROFILE_COUNTERS] = {0};
+    for (struct thread_counters* thread = all; thread; thread = thread->next) {
+      uint64_t* chunk = __atomic_load_n(&thread->chunks[i / CHUNK], __ATOMIC_ACQUIRE);
+      if (!chunk) continue;
+
+      for (int c = 0; c < HELLSCAPE_PROFILE_COUNTERS; c++) {
+        sum[c] += chunk[(i % CHUNK) * HELLSCAPE_PROFILE_COUNTERS + c];
+      }
+    }
+
+    if (!sum[HELLSCAPE_PROFILE_DISPATCHES] && !sum[HELLSCAPE_PROFILE_PREDICATES] &&
+        !sum[HELLSCAPE_PROFILE_INSTRUCTIONS]) {
+      continue;
+    }
+
+    // e.g.: {"function":"main","tu":"a.c","dispatches":120,"predicates":7,"instructions":48,
+    //        "cost":772.5}
+    const struct function_info* info = &functions[i / CHUNK][i % CHUNK];
+    fputs("{\"function\":", out);
+    print_string(out, info->function);
+    fputs(",\"tu\":", out);
+    print_string(out, info->tu);
+    fprintf(out, ",\"dispatches\":%llu,\"predicates\":%llu,\"instructions\":%llu",
+            (unsigned long long) sum[HELLSCAPE_PROFILE_DISPATCHES],
+            (unsigned long long) sum[HELLSCAPE_PROFILE_PREDICATES],
+            (unsigned long long) sum[HELLSCAPE_PROFILE_INSTRUCTIONS]);
+    fprintf(out, ",\"cost\":%.17g}\n",
+            (double) sum[HELLSCAPE_PROFILE_COST] / HELLSCAPE_PROFILE_COST_SCALE);
+  }
+
+  if (fclose(out) != 0) {
+    free(buffer);
+    return;
+  }
+
+  char path[64];
+  const char* target = getenv("HELLSCAPE_PROFILE");
+  if (!target || !*target) {
+    snprintf(path, sizeof(path), "hellscape-profile.%d.jsonl", (int) getpid());
+    target = path;
+  }
+
+  int fd = open(target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd >= 0) {
+    if (size > 0 && write(fd, buffer, size) != (ssize_t) size) {
+      fprintf(stderr, "hellscape-profile: short write to %s\n", target);
+    }
+    close(fd);
+  } else {
+    fprintf(stderr, "hellscape-profile: cannot open %s\n", target);
+  }
+
+  free(buffer);
+}
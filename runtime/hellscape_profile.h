@@ -0,0 +1,56 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Counters of every function, shared with the plugin's Instrument::Counter.
+#define HELLSCAPE_PROFILE_DISPATCHES 0
+#define HELLSCAPE_PROFILE_PREDICATES 1
+#define HELLSCAPE_PROFILE_INSTRUCTIONS 2
+// What the plugin's budget charged for the dispatches and predicates, priced
+// for the target, in 1/HELLSCAPE_PROFILE_COST_SCALE of an instruction.
+#define HELLSCAPE_PROFILE_COST 3
+#define HELLSCAPE_PROFILE_COUNTERS 4
+
+#define HELLSCAPE_PROFILE_COST_SCALE 100
+
+/**
+ * Called on entry to every function built with -fplugin-arg-hellscape-profile.
+ * Assigns the function a slot the first time any thread calls it, then returns
+ * the calling thread's counters for it, which the function adds to without
+ * atomics. Never fails, if the counters can't be allocated they are dropped.
+ *
+ * The counters of all threads are summed and appended to $HELLSCAPE_PROFILE
+ * (hellscape-profile.<pid>.jsonl by default) at exit, one JSON line per
+ * function, for hellscape-profile-report.
+ *
+ * @param slot static of the function, 0 until it has a slot
+ * @param function name of the function
+ * @param tu translation unit the function was compiled in
+ * @return HELLSCAPE_PROFILE_COUNTERS counters of the function for this thread
+ */
+uint64_t* __hellscape_profile_attach(uint32_t* slot, const char* function, const char* tu);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,631 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * hellscape-policy: compiles a textual policy into the index mapped by
+ * -fplugin-arg-hellscape-policy=<file>.
+ *
+ *   $ hellscape-policy policy.txt policy.hsp
+ *   $ hellscape-policy --match policy.hsp check_license memcpy_fast
+ *
+ * Every line of the policy is a pattern, the passes and optional parameters,
+ * the first matching line wins:
+ *
+ *   # pattern             passes        parameters
+ *   check_license         fla,bcf,sub   subLoop=3
+ *   *_fast                off
+ *   re:crypto_(en|de).*   bcf
+ *   *                     default       subLoop=1
+ *
+ * Patterns are globs (*, ? and [...] classes) matched against the whole name,
+ * or extended regular expressions when prefixed with "re:": (), |, ., [...],
+ * *, +, ?, {m}, {m,} and {m,n} (up to 255), and \ escapes. A "{" which does
+ * not start a bound is an error, "\{" matches it. "off" disables all passes,
+ * "default" keeps the passes given on the command line.
+ */
+
+#include "../Policy.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// Refuse policies whose DFA explodes rather than writing a huge file.
+static const size_t MAX_STATES = 1 << 16;
+
+// Largest bound of x{m,n}, every repetition is a copy of x in the NFA.
+static const unsigned MAX_BOUND = 255;
+static const unsigned UNBOUNDED = ~0u;
+
+/**
+ * Thompson NFA for all patterns of a policy.
+ */
+class Nfa {
+public:
+  struct Node {
+    // Consuming transition to out on any of these bytes.
+    std::bitset<256> bytes;
+    int out = -1;
+    std::vector<int> eps;
+    // Accepts the name for this rule.
+    int rule = -1;
+  };
+
+  std::vector<Node> nodes;
+
+  Nfa() {
+    // Node 0 is the start, with an epsilon transition to every pattern.
+    nodes.emplace_back();
+  }
+
+  /**
+   * Add a pattern, as an extended regular expression matching the whole name.
+   */
+  void add(const std::string& regex, int rule) {
+    mRegex = regex;
+    mPos = 0;
+
+    Fragment f = parse_alt();
+    if (mPos != mRegex.size()) {
+      throw std::runtime_error("unbalanced ')' in '" + regex + "'");
+    }
+
+    nodes[0].eps.push_back(f.start);
+    nodes[f.end].rule = rule;
+  }
+
+private:
+  struct Fragment {
+    int start;
+    int end;
+  };
+
+  std::string mRegex;
+  size_t mPos = 0;
+
+  int node() {
+    nodes.emplace_back();
+    return (int) nodes.size() - 1;
+  }
+
+  Fragment empty() {
+    int n = node();
+    return {n, n};
+  }
+
+  Fragment bytes(const std::bitset<256>& set) {
+    int start = node();
+    int end = node();
+    nodes[start].bytes = set;
+    nodes[start].out = end;
+    return {start, end};
+  }
+
+  bool peek(char c) const {
+    return mPos < mRegex.size() && mRegex[mPos] == c;
+  }
+
+  // alt := seq ('|' seq)*
+  Fragment parse_alt() {
+    Fragment left = parse_seq();
+    while (peek('|')) {
+      mPos++;
+      Fragment right = parse_seq();
+
+      int start = node();
+      int end = node();
+      nodes[start].eps = {left.start, right.start};
+      nodes[left.end].eps.push_back(end);
+      nodes[right.end].eps.push_back(end);
+      left = {start, end};
+    }
+
+    return left;
+  }
+
+  // seq := repeat*
+  Fragment parse_seq() {
+    Fragment seq = empty();
+    while (mPos < mRegex.size() && !peek('|') && !peek(')')) {
+      Fragment next = parse_repeat();
+      nodes[seq.end].eps.push_back(next.start);
+      seq.end = next.end;
+    }
+
+    return seq;
+  }
+
+  // repeat := atom ('*' | '+' | '?' | '{' bounds '}')*
+  Fragment parse_repeat() {
+    // The nodes of the atom, and of what repeats it, are the ones from here on.
+    int first = (int) nodes.size();
+
+    Fragment atom = parse_atom();
+    while (peek('*') || peek('+') || peek('?') || peek('{')) {
+      char op = mRegex[mPos++];
+      if (op == '{') {
+        unsigned min, max;
+        parse_bounds(&min, &max);
+        atom = bounded(atom, first, min, max);
+      } else {
+        atom = closure(atom, op);
+      }
+    }
+
+    return atom;
+  }
+
+  Fragment closure(Fragment atom, char op) {
+    int start = node();
+    int end = node();
+    nodes[start].eps.push_back(atom.start);
+    if (op != '+') nodes[start].eps.push_back(end);
+    nodes[atom.end].eps.push_back(end);
+    if (op != '?') nodes[atom.end].eps.push_back(atom.start);
+    return {start, end};
+  }
+
+  // After the '{': m '}' | m ',' '}' | m ',' n '}'
+  void parse_bounds(unsigned* min, unsigned* max) {
+    auto number = [&]() {
+      unsigned n = 0;
+      size_t start = mPos;
+      while (mPos < mRegex.size() && isdigit((unsigned char) mRegex[mPos])) {
+        n = std::min(n * 10 + (mRegex[mPos++] - '0'), MAX_BOUND + 1);
+      }
+      if (mPos == start) throw std::runtime_error("malformed bound in '" + mRegex + "'");
+      if (n > MAX_BOUND) {
+        throw std::runtime_error("bound over " + std::to_string(MAX_BOUND) + " in '" + mRegex +
+                                 "'");
+      }
+      return n;
+    };
+
+    *min = number();
+    *max = *min;
+    if (peek(',')) {
+      mPos++;
+      *max = peek('}') ? UNBOUNDED : number();
+    }
+
+    if (!peek('}')) throw std::runtime_error("malformed bound in '" + mRegex + "'");
+    mPos++;
+
+    if (*max < *min) throw std::runtime_error("bad bound in '" + mRegex + "'");
+  }
+
+  /**
+   * Copy a fragment whose nodes are the ones from first on.
+   */
+  Fragment copy(Fragment f, int first, int last) {
+    int delta = (int) nodes.size() - first;
+    for (int i = first; i < last; i++) {
+      Node n = nodes[i];
+      if (n.out >= 0) n.out += delta;
+      for (int& target : n.eps) target += delta;
+      nodes.push_back(n);
+    }
+
+    return {f.start + delta, f.end + delta};
+  }
+
+  // x{m,n} as m copies of x followed by n - m optional ones, x{m,} as m copies
+  // followed by x*.
+  Fragment bounded(Fragment atom, int first, unsigned min, unsigned max) {
+    int last = (int) nodes.size();
+    unsigned count = max == UNBOUNDED ? std::max(min, 1u) : max;
+
+    // Copy before wiring anything, the atom is the template.
+    std::vector<Fragment> copies;
+    for (unsigned i = 0; i < count; i++) copies.push_back(i ? copy(atom, first, last) : atom);
+
+    Fragment seq = empty();
+    for (unsigned i = 0; i < count; i++) {
+      Fragment next = copies[i];
+      if (max == UNBOUNDED && i == count - 1) {
+        // The last copy repeats, once more if min is 0 and once less otherwise.
+        next = closure(next, min == 0 ? '*' : '+');
+      } else if (i >= min) {
+        next = closure(next, '?');
+      }
+
+      nodes[seq.end].eps.push_back(next.start);
+      seq.end = next.end;
+    }
+
+    return seq;
+  }
+
+  // atom := '(' alt ')' | '.' | '[' class ']' | '\' char | '^' | '$' | char
+  Fragment parse_atom() {
+    char c = mRegex[mPos++];
+    switch (c) {
+    case '(': {
+      Fragment inner = parse_alt();
+      if (!peek(')')) throw std::runtime_error("missing ')' in '" + mRegex + "'");
+      mPos++;
+      return inner;
+    }
+    case '.': {
+      std::bitset<256> all;
+      all.set();
+      return bytes(all);
+    }
+    case '[':
+      return bytes(parse_class());
+    case '\\':
+      if (mPos == mRegex.size()) {
+        throw std::runtime_error("trailing '\\' in '" + mRegex + "'");
+      }
+      return bytes(std::bitset<256>().set((uint8_t) mRegex[mPos++]));
+    case '^':
+    case '$':
+      // Patterns always match the whole name.
+      return empty();
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+      throw std::runtime_error(std::string("nothing to repeat with '") + c +
+                               "' in '" + mRegex + "'");
+    default:
+      return bytes(std::bitset<256>().set((uint8_t) c));
+    }
+  }
+
+  // After the '[': '^'? ']'? (char | char '-' char)* ']'
+  std::bitset<256> parse_class() {
+    std::bitset<256> set;
+    bool negate = peek('^');
+    if (negate) mPos++;
+
+    bool first = true;
+    while (mPos < mRegex.size() && (first || !peek(']'))) {
+      first = false;
+
+      auto lo = (uint8_t) mRegex[mPos++];
+      if (lo == '\\' && mPos < mRegex.size()) lo = (uint8_t) mRegex[mPos++];
+
+      uint8_t hi = lo;
+      if (peek('-') && mPos + 1 < mRegex.size() && mRegex[mPos + 1] != ']') {
+        mPos++;
+        hi = (uint8_t) mRegex[mPos++];
+        if (hi == '\\' && mPos < mRegex.size()) hi = (uint8_t) mRegex[mPos++];
+        if (hi < lo) throw std::runtime_error("bad range in '" + mRegex + "'");
+      }
+
+      for (unsigned b = lo; b <= hi; b++) set.set(b);
+    }
+
+    if (!peek(']')) throw std::runtime_error("missing ']' in '" + mRegex + "'");
+    mPos++;
+
+    return negate ? ~set : set;
+  }
+};
+
+/**
+ * Translate a glob into an extended regular expression.
+ */
+static std::string glob_to_regex(const std::string& glob) {
+  std::string regex;
+  for (size_t i = 0; i < glob.size(); i++) {
+    char c = glob[i];
+    switch (c) {
+    case '*':
+      regex += ".*";
+      break;
+    case '?':
+      regex += ".";
+      break;
+    case '[': {
+      // Copy the class, [!...] negates like [^...].
+      size_t end = glob.find(']', i + 2);
+      if (end == std::string::npos) throw std::runtime_error("missing ']' in '" + glob + "'");
+
+      std::string cls = glob.substr(i + 1, end - i - 1);
+      if (!cls.empty() && cls[0] == '!') cls[0] = '^';
+      regex += "[" + cls + "]";
+      i = end;
+      break;
+    }
+    default:
+      if (strchr("\\.^$|()+{}", c)) regex += '\\';
+      regex += c;
+      break;
+    }
+  }
+
+  return regex;
+}
+
+/**
+ * Subset construction over byte classes.
+ */
+class Dfa {
+public:
+  Policy::Header header{};
+  std::vector<uint32_t> transitions;
+  std::vector<int32_t> accept;
+
+  explicit Dfa(const Nfa& nfa) : mNfa(nfa) {
+    memcpy(header.magic, Policy::MAGIC, sizeof(Policy::MAGIC));
+    header.version = Policy::VERSION;
+
+    compute_classes();
+
+    std::vector<int> start = closure({0});
+    state(start);
+
+    // States are numbered in discovery order, so this is a BFS.
+    for (size_t s = 0; s < mSets.size(); s++) {
+      std::vector<int> set = mSets[s];
+
+      for (uint32_t cls = 0; cls < header.classes; cls++) {
+        uint8_t b = mRepresentative[cls];
+
+        std::vector<int> next;
+        for (int n : set) {
+          const Nfa::Node& node = mNfa.nodes[n];
+          if (node.out >= 0 && node.bytes.test(b)) next.push_back(node.out);
+        }
+
+        transitions.push_back(next.empty() ? Policy::DEAD : state(closure(next)));
+      }
+    }
+
+    header.states = (uint32_t) mSets.size();
+  }
+
+private:
+  const Nfa& mNfa;
+  std::vector<uint8_t> mRepresentative;
+  std::map<std::vector<int>, uint32_t> mStates;
+  std::vector<std::vector<int>> mSets;
+
+  void compute_classes() {
+    // Two bytes are equivalent if every consuming transition treats them alike.
+    std::map<std::vector<bool>, uint8_t> classes;
+    for (unsigned b = 0; b < 256; b++) {
+      std::vector<bool> signature;
+      for (auto& node : mNfa.nodes) {
+        if (node.out >= 0) signature.push_back(node.bytes.test(b));
+      }
+
+      auto it = classes.find(signature);
+      if (it == classes.end()) {
+        it = classes.emplace(signature, (uint8_t) mRepresentative.size()).first;
+        mRepresentative.push_back((uint8_t) b);
+      }
+
+      header.byteClass[b] = it->second;
+    }
+
+    header.classes = (uint32_t) mRepresentative.size();
+  }
+
+  std::vector<int> closure(std::vector<int> set) const {
+    std::vector<bool> seen(mNfa.nodes.size());
+    std::vector<int> stack = set;
+    for (int n : set) seen[n] = true;
+
+    while (!stack.empty()) {
+      int n = stack.back();
+      stack.pop_back();
+
+      for (int e : mNfa.nodes[n].eps) {
+        if (seen[e]) continue;
+        seen[e] = true;
+        set.push_back(e);
+        stack.push_back(e);
+      }
+    }
+
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+    return set;
+  }
+
+  uint32_t state(const std::vector<int>& set) {
+    auto it = mStates.find(set);
+    if (it != mStates.end()) return it->second;
+
+    if (mSets.size() >= MAX_STATES) {
+      throw std::runtime_error("policy too complex, simplify the patterns");
+    }
+
+    // The first rule in the file wins.
+    int32_t rule = -1;
+    for (int n : set) {
+      int r = mNfa.nodes[n].rule;
+      if (r >= 0 && (rule < 0 || r < rule)) rule = r;
+    }
+
+    auto id = (uint32_t) mSets.size();
+    mStates.emplace(set, id);
+    mSets.push_back(set);
+    accept.push_back(rule);
+    return id;
+  }
+};
+
+/**
+ * Parse a policy line into its rule, e.g.: "fla,bcf subLoop=3".
+ */
+static Policy::Rule parse_rule(std::istringstream& fields) {
+  Policy::Rule rule{};
+
+  std::string passes;
+  if (!(fields >> passes)) throw std::runtime_error("missing passes");
+
+  if (passes == "off") {
+    rule.flags |= Policy::HAS_PASSES;
+  } else if (passes != "default") {
+    rule.flags |= Policy::HAS_PASSES;
+
+    std::istringstream list(passes);
+    std::string pass;
+    while (std::getline(list, pass, ',')) {
+      uint32_t bit = Policy::pass_bit(pass.c_str());
+      if (bit == 0) throw std::runtime_error("unknown pass '" + pass + "'");
+      rule.passes |= bit;
+    }
+  }
+
+  std::string parameter;
+  while (fields >> parameter) {
+    if (parameter.rfind("subLoop=", 0) == 0) {
+      const char* value = parameter.c_str() + sizeof("subLoop=") - 1;
+      char* none;
+      rule.subLoop = strtoul(value, &none, 10);
+      if (*value == 0 || *none != 0) {
+        throw std::runtime_error("malformed '" + parameter + "'");
+      }
+      rule.flags |= Policy::HAS_SUB_LOOP;
+    } else {
+      throw std::runtime_error("unknown parameter '" + parameter + "'");
+    }
+  }
+
+  return rule;
+}
+
+static int compile(const char* input, const char* output) {
+  std::ifstream in(input);
+  if (!in) {
+    std::cerr << "error: cannot open " << input << "\n";
+    return 1;
+  }
+
+  Nfa nfa;
+  std::vector<Policy::Rule> rules;
+
+  std::string line;
+  for (int number = 1; std::getline(in, line); number++) {
+    size_t comment = line.find('#');
+    if (comment != std::string::npos) line.erase(comment);
+
+    std::istringstream fields(line);
+    std::string pattern;
+    if (!(fields >> pattern)) continue;
+
+    try {
+      rules.push_back(parse_rule(fields));
+      if (pattern.rfind("re:", 0) == 0) {
+        nfa.add(pattern.substr(3), (int) rules.size() - 1);
+      } else {
+        nfa.add(glob_to_regex(pattern), (int) rules.size() - 1);
+      }
+    } catch (const std::runtime_error& e) {
+      std::cerr << input << ":" << number << ": error: " << e.what() << "\n";
+      return 1;
+    }
+  }
+
+  try {
+    Dfa dfa(nfa);
+    dfa.header.rules = (uint32_t) rules.size();
+
+    // Write next to the output and rename, so parallel builds never map a
+    // partially written policy.
+    std::string temporary = std::string(output) + ".tmp." + std::to_string(getpid());
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write((const char*) &dfa.header, sizeof(dfa.header));
+    out.write((const char*) dfa.transitions.data(),
+              dfa.transitions.size() * sizeof(uint32_t));
+    out.write((const char*) dfa.accept.data(), dfa.accept.size() * sizeof(int32_t));
+    out.write((const char*) rules.data(), rules.size() * sizeof(Policy::Rule));
+    out.close();
+
+    if (!out || rename(temporary.c_str(), output) != 0) {
+      std::cerr << "error: cannot write " << output << ": " << strerror(errno) << "\n";
+      unlink(temporary.c_str());
+      return 1;
+    }
+
+    std::cerr << output << ": " << rules.size() << " rules, "
+              << dfa.header.states << " states, " << dfa.header.classes
+              << " byte classes\n";
+  } catch (const std::runtime_error& e) {
+    std::cerr << input << ": error: " << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+static int match(const char* path, int argc, char** argv) {
+  std::string error;
+  Policy* policy = Policy::open(path, &error);
+  if (!policy) {
+    std::cerr << "error: " << error << "\n";
+    return 1;
+  }
+
+  for (int i = 0; i < argc; i++) {
+    std::cout << argv[i] << ":";
+
+    const Policy::Rule* rule = policy->lookup(argv[i]);
+    if (!rule) {
+      std::cout << " no match\n";
+      continue;
+    }
+
+    if (rule->flags & Policy::HAS_PASSES) {
+      std::cout << (rule->passes & Policy::FLA ? " fla" : "")
+                << (rule->passes & Policy::BCF ? " bcf" : "")
+                << (rule->passes & Policy::SUB ? " sub" : "")
+                << (rule->passes & Policy::STR ? " str" : "")
+                << (rule->passes & Policy::CON ? " con" : "")
+                << (rule->passes == 0 ? " off" : "");
+    } else {
+      std::cout << " default";
+    }
+
+    if (rule->flags & Policy::HAS_SUB_LOOP) std::cout << " subLoop=" << rule->subLoop;
+    std::cout << "\n";
+  }
+
+  delete policy;
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc >= 3 && std::string(argv[1]) == "--match") {
+    return match(argv[2], argc - 3, argv + 3);
+  }
+
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " <policy.txt> <policy.hsp>\n"
+              << "       " << argv[0] << " --match <policy.hsp> <name>...\n";
+    return 1;
+  }
+
+  return compile(argv[1], argv[2]);
+}
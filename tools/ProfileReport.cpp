@@ -0,0 +1,231 @@
+/*
+ * This file is part of Hellscape.
+ *
+ * Hellscape is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Hellscape is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Hellscape.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * hellscape-profile-report: ranks the functions of a binary built with
+ * -fplugin-arg-hellscape-profile by what their obfuscation cost at run time.
+ *
+ *   $ HELLSCAPE_PROFILE=run.jsonl ./server --self-test
+ *   $ hellscape-profile-report run.jsonl
+ *   $ hellscape-profile-report --top 20 --policy run.jsonl > hot.txt
+ *
+ * The dumps of several runs (or processes) are summed per function. The
+ * estimated cost is what the budget charged for every dispatch and predicate,
+ * priced for the target when the plugin instrumented them (the dump's "cost"),
+ * plus the statements substitution added, so the functions at the top are
+ * the ones to exclude first; --policy prints them as "off" lines for
+ * hellscape-policy.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct Entry {
+  std::string function;
+  std::string tu;
+  uint64_t dispatches = 0;
+  uint64_t predicates = 0;
+  uint64_t instructions = 0;
+  // What the budget charged for the dispatches and predicates, in instructions.
+  double charged = 0;
+
+  // SUB's rewrites are charged one per statement they add.
+  double cost() const {
+    return charged + instructions;
+  }
+};
+
+/**
+ * Find the value of "key": in a JSON line.
+ *
+ * @return the raw value (a number or an unescaped string without the quotes),
+ * empty if missing
+ */
+static std::string field(const std::string& line, const std::string& key) {
+  std::string needle = "\"" + key + "\":";
+  size_t pos = line.find(needle);
+  if (pos == std::string::npos) return "";
+
+  pos += needle.size();
+  if (pos >= line.size() || line[pos] != '"') {
+    size_t end = line.find_first_of(",}", pos);
+    return line.substr(pos, end - pos);
+  }
+
+  std::string value;
+  for (size_t i = pos + 1; i < line.size() && line[i] != '"'; i++) {
+    if (line[i] != '\\' || i + 1 == line.size()) {
+      value += line[i];
+    } else if (line[++i] == 'u') {
+      // The runtime only escapes control characters this way.
+      value += (char) strtoul(line.substr(i + 1, 4).c_str(), nullptr, 16);
+      i += 4;
+    } else {
+      value += line[i];
+    }
+  }
+
+  return value;
+}
+
+/**
+ * A policy pattern matching exactly the name, a glob when the name has no
+ * glob metacharacters and an escaped regular expression otherwise.
+ *
+ * @return the pattern, empty if the policy syntax can't express the name
+ */
+static std::string pattern(const std::string& name) {
+  bool glob = true;
+  for (char c : name) {
+    if (isspace((unsigned char) c) || c == '#') return "";
+    if (strchr("*?[\\", c)) glob = false;
+  }
+
+  if (glob && name.rfind("re:", 0) != 0) return name;
+
+  std::string regex = "re:";
+  for (char c : name) {
+    if (!isalnum((unsigned char) c) && c != '_') regex += '\\';
+    regex += c;
+  }
+
+  return regex;
+}
+
+static void usage(const char* name) {
+  std::cerr << "usage: " << name << " [--sort cost|dispatches|predicates|instructions]\n"
+            << "       [--top <n>] [--policy] <profile.jsonl>...\n";
+}
+
+int main(int argc, char** argv) {
+  std::string sort = "cost";
+  size_t top = 0;
+  bool policy = false;
+  std::vector<std::string> inputs;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--policy") {
+      policy = true;
+    } else if ((arg == "--sort" || arg == "--top") && i + 1 < argc) {
+      std::string value = argv[++i];
+      if (arg == "--top") {
+        top = strtoull(value.c_str(), nullptr, 10);
+      } else {
+        sort = value;
+      }
+    } else if (arg.rfind("--", 0) == 0) {
+      usage(argv[0]);
+      return 1;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+
+  if (inputs.empty() || (sort != "cost" && sort != "dispatches" && sort != "predicates" &&
+                         sort != "instructions")) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::map<std::pair<std::string, std::string>, Entry> entries;
+  for (const std::string& input : inputs) {
+    std::ifstream in(input);
+    if (!in) {
+      std::cerr << "error: cannot open " << input << "\n";
+      return 1;
+    }
+
+    std::string line;
+    for (int number = 1; std::getline(in, line); number++) {
+      if (line.empty()) continue;
+
+      std::string function = field(line, "function");
+      if (function.empty()) {
+        std::cerr << input << ":" << number << ": error: missing function\n";
+        return 1;
+      }
+
+      std::string tu = field(line, "tu");
+      Entry& entry = entries[{function, tu}];
+      entry.function = function;
+      entry.tu = tu;
+      entry.dispatches += strtoull(field(line, "dispatches").c_str(), nullptr, 10);
+      entry.predicates += strtoull(field(line, "predicates").c_str(), nullptr, 10);
+      entry.instructions += strtoull(field(line, "instructions").c_str(), nullptr, 10);
+      entry.charged += strtod(field(line, "cost").c_str(), nullptr);
+    }
+  }
+
+  std::vector<Entry> ranked;
+  for (auto& it : entries) ranked.push_back(it.second);
+
+  auto key = [&](const Entry& entry) -> double {
+    if (sort == "dispatches") return entry.dispatches;
+    if (sort == "predicates") return entry.predicates;
+    if (sort == "instructions") return entry.instructions;
+    return entry.cost();
+  };
+  std::stable_sort(ranked.begin(), ranked.end(), [&](const Entry& a, const Entry& b) {
+    return key(a) > key(b);
+  });
+  if (top > 0 && ranked.size() > top) ranked.resize(top);
+
+  if (policy) {
+    // Static functions of the same name in different units share a line.
+    std::map<std::string, bool> printed;
+    std::cout << "# hottest obfuscated functions by " << sort << "\n";
+    for (const Entry& entry : ranked) {
+      if (printed[entry.function]) continue;
+      printed[entry.function] = true;
+
+      std::string p = pattern(entry.function);
+      if (p.empty()) {
+        std::cout << "# not expressible: " << entry.function << "\n";
+      } else {
+        std::cout << p << " off\n";
+      }
+    }
+    return 0;
+  }
+
+  double total = 0;
+  for (auto& it : entries) total += it.second.cost();
+
+  std::cout << std::left << std::setw(32) << "function" << std::setw(24) << "tu" << std::right
+            << std::setw(14) << "dispatches" << std::setw(14) << "predicates" << std::setw(14)
+            << "instructions" << std::setw(16) << "est. cost" << std::setw(8) << "%" << "\n";
+  for (const Entry& entry : ranked) {
+    std::cout << std::left << std::setw(32) << entry.function << std::setw(24) << entry.tu
+              << std::right << std::setw(14) << entry.dispatches << std::setw(14)
+              << entry.predicates << std::setw(14) << entry.instructions << std::fixed
+              << std::setprecision(0) << std::setw(16) << entry.cost() << std::setprecision(1)
+              << std::setw(8) << (total > 0 ? 100 * entry.cost() / total : 0) << "\n";
+  }
+
+  return 0;
+}